@@ -9,18 +9,28 @@ LOCAL_SRC_FILES += \
 LOCAL_SRC_FILES += \
 	SecCamera.cpp \
 	SecV4L2Adapter.cpp \
+	SecV4L2Reactor.cpp \
+	SecV4L2Caps.cpp \
+	SecV4L2Stats.cpp \
+	SecV4L2Device.cpp \
+	SecV4L2FakeDevice.cpp \
+
+# preview color conversion, with the NEON kernels where the CPU has them
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_SRC_FILES += ColorConvert.cpp.neon
+else
+LOCAL_SRC_FILES += ColorConvert.cpp
+endif
 
 LOCAL_SRC_FILES += \
+        FrameQueue.cpp \
+        ConvertPool.cpp \
         CameraHardware.cpp \
         CameraDeviceModule.cpp
 
 LOCAL_SHARED_LIBRARIES := libutils libui liblog libbinder libdl libcutils
 LOCAL_SHARED_LIBRARIES += libhardware libcamera_client
 
-# libyuv
-LOCAL_STATIC_LIBRARIES += libyuv_static
-LOCAL_C_INCLUDES += external/libyuv/files/include
-
 # Software encoder
 LOCAL_CFLAGS += -DLIBJPEG_ENCODER
 LOCAL_SHARED_LIBRARIES += libjpeg
@@ -45,3 +55,35 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE := camera.$(TARGET_DEVICE)
 include $(BUILD_SHARED_LIBRARY)
 
+# Host benchmark of the color conversion kernels, see ColorConvertBench.cpp
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	ColorConvertBench.cpp \
+	ColorConvert.cpp \
+	HostLog.cpp
+LOCAL_CFLAGS += -O2 -msse2
+LOCAL_LDLIBS += -lrt
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := colorconvert_bench
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host driver of SecCamera against the synthetic sensor, see
+# FakeCameraBench.cpp
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	FakeCameraBench.cpp \
+	SecCamera.cpp \
+	SecV4L2Adapter.cpp \
+	SecV4L2Reactor.cpp \
+	SecV4L2Caps.cpp \
+	SecV4L2Stats.cpp \
+	SecV4L2Device.cpp \
+	SecV4L2FakeDevice.cpp \
+	HostLog.cpp
+LOCAL_CFLAGS += -DCAMERA_BACKEND_DEF=\"fake\"
+LOCAL_C_INCLUDES += frameworks/base/libs/camera
+LOCAL_STATIC_LIBRARIES := libutils libcutils
+LOCAL_LDLIBS += -lpthread -lrt
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE := fakecamera_bench
+include $(BUILD_HOST_EXECUTABLE)
@@ -45,11 +45,16 @@ const char* camera_info_get_default_camera_param_str(int camera_id)
         "picture-size=2560x1920;"
         "picture-size-values="
         // "3264x2448,3264x1968,"
-        // "2560x1920,2048x1536,2048x1536,2048x1232,"
+        "2560x1920,2048x1536,"
+        // "2048x1232,"
         "1600x1200,1600x960,"
         "800x480,640x480;"
         "picture-format=jpeg;"
         "picture-format-values=jpeg;"
+        "zsl=off;"
+        "burst-count=1;"
+        "max-burst-count=10;"
+        "zsl-values=off,on;"
         "jpeg-thumbnail-width=320;"
         "jpeg-thumbnail-height=240;"
         "jpeg-thumbnail-size-values=320x240,0x0;"
@@ -18,7 +18,6 @@
 #define LOG_TAG "CameraHardware"
 #include <utils/Log.h>
 
-#include <libyuv.h>
 #include <ui/Rect.h>
 #include <ui/GraphicBufferMapper.h>
 #include <media/stagefright/MetadataBufferType.h>
@@ -33,8 +32,23 @@ struct ADDRS {
     unsigned int addr_y;
     unsigned int addr_cbcr;
     unsigned int buf_idx;
+    int buf_fd;
 };
 
+// msecs to wait for a frame before re-checking preview state
+#define PREVIEW_WAIT_TIMEOUT    (1000)
+#define PREVIEW_WIN_SPARE_BUFS  (2)
+// window buffers the camera owns at once when capturing into them
+#define PREVIEW_WIN_DIRECT_BUFS (MIN_CAM_BUFFERS + 1)
+// preview frames out of the driver on the present thread: the one being
+// presented, and one queued behind it
+#define PREVIEW_PRESENT_HELD    (2)
+
+// zero shutter lag, "on" or "off"
+#define KEY_ZSL                 "zsl"
+// pictures taken by one takePicture()
+#define KEY_BURST_COUNT         "burst-count"
+
 #define CALL_WIN(F, ...)                                        \
     if (_window) {                                              \
         if (_window->F(_window, __VA_ARGS__)) {                 \
@@ -48,6 +62,7 @@ CameraHardware::CameraHardware(int cameraId)
       _camera(NULL),
       _msgs(0),
       _previewHeap(NULL),
+      _callbackHeap(NULL),
       _rawHeap(NULL),
       _recordHeap(NULL),
       _cbNotify(NULL),
@@ -56,10 +71,21 @@ CameraHardware::CameraHardware(int cameraId)
       _cbReqMemory(NULL),
       _cbCookie(NULL),
       _parms(),
-      _window(NULL)
+      _window(NULL),
+      _isWindowDirect(false),
+      _winBufCnt(0),
+      _winBufMax(0),
+      _winBufOwed(0)
 {
     LOGI("%s :", __func__);
 
+    for (int i = 0; i < MAX_CAM_BUFFERS; i++)
+        _previewBufHeaps[i] = NULL;
+
+    memset(_previewLatency, 0, sizeof(_previewLatency));
+    memset(_recordLatency, 0, sizeof(_recordLatency));
+    memset(_winBufs, 0, sizeof(_winBufs));
+
     _camera = new SecCamera(cameraId);
     if (_camera->getFd() == 0) {
         delete _camera;
@@ -77,6 +103,9 @@ CameraHardware::CameraHardware(int cameraId)
     _previewState = PREVIEW_IDLE;
     _previewThread = new PreviewThread(this);
     _previewThread->startLoop();
+    _presentThread = new PresentThread(this);
+    _presentThread->startLoop();
+    _convertPool.start();
 
     LOGI("%s: start focus thread", __func__);
     _focusState = FOCUS_IDLE;
@@ -85,8 +114,24 @@ CameraHardware::CameraHardware(int cameraId)
 
     LOGI("%s: prepare picture thread", __func__);
     _pictureState = PICTURE_IDLE;
+    _shutterTime = 0;
+    _captureMode = CAPTURE_STOP_PREVIEW;
+    _burstQueueCnt = 0;
+    _burstDone = false;
+    _burstDelivered = 0;
+    _burstLastDelivery = 0;
+    memset(&_burstStat, 0, sizeof(_burstStat));
     _pictureThread = new PictureThread(this);
 
+    LOGI("%s: start monitor thread", __func__);
+    _monitorExit = false;
+    _dropAlarms = 0;
+    _lastDropPermille = 0;
+    _lastDropStream = NULL;
+    _camera->setDropCallback(_dropCallback, this);
+    _monitorThread = new MonitorThread(this);
+    _monitorThread->startLoop();
+
     LOGI("CameraHardware inited");
 }
 
@@ -99,6 +144,51 @@ void CameraHardware::_initParams(void)
 {
     String8 strCamParam(camera_info_get_default_camera_param_str(_cameraId));
     _parms.unflatten(strCamParam);
+
+    // the driver knows better than the defaults what it can do
+    String8 values;
+    if (!_camera->getSupportedSizes(_parms.getPreviewFormat(), values))
+        _setSupportedValues(CameraParameters::KEY_PREVIEW_SIZE,
+                            CameraParameters::KEY_SUPPORTED_PREVIEW_SIZES,
+                            values);
+
+    if (!_camera->getSupportedSizes(_parms.getPictureFormat(), values))
+        _setSupportedValues(CameraParameters::KEY_PICTURE_SIZE,
+                            CameraParameters::KEY_SUPPORTED_PICTURE_SIZES,
+                            values);
+
+    if (!_camera->getSupportedFrameRates(_parms.getPreviewFormat(), values))
+        _setSupportedValues(CameraParameters::KEY_PREVIEW_FRAME_RATE,
+                            CameraParameters::KEY_SUPPORTED_PREVIEW_FRAME_RATES,
+                            values);
+}
+
+// Replace the value list of a parameter. The current value moves to the
+// first of the list if it isn't in there.
+void CameraHardware::_setSupportedValues(const char* key, const char* valuesKey,
+                                         const String8& values)
+{
+    const char* value = _parms.get(key);
+    const char* list = values.string();
+    size_t len = value ? strlen(value) : 0;
+
+    bool found = false;
+    for (const char* p = list; len && p; p = strchr(p, ',')) {
+        if (*p == ',')
+            p++;
+        if (!strncmp(p, value, len) && (p[len] == ',' || p[len] == 0)) {
+            found = true;
+            break;
+        }
+    }
+
+    _parms.set(valuesKey, list);
+    if (!found) {
+        String8 first(list, strcspn(list, ","));
+        LOGW("%s: %s=%s not supported. using %s", __func__,
+             key, value ? value : "(null)", first.string());
+        _parms.set(key, first.string());
+    }
 }
 
 CameraHardware::~CameraHardware()
@@ -111,30 +201,22 @@ status_t CameraHardware::setPreviewWindow(preview_stream_ops* window)
 {
     Mutex::Autolock lock(_previewLock);
 
-    _window = window;
-
+    // before the window changes, as window buffers go back to the old one
     if (_previewState == PREVIEW_RUNNING) {
         LOGI("Preview window changed while preview is running");
         _stopPreviewLocked();
     }
 
+    _window = window;
+
     if (_window == NULL) {
         LOGV("%s: received NULL window!", __func__);
         return OK;
     }
 
-    int minWinBufs = 0;
-    CALL_WIN(get_min_undequeued_buffer_count, &minWinBufs);
-    LOGE_IF(minWinBufs >= MAX_CAM_BUFFERS,
-            "minWinBufs, %d is too high! expected at most %d.",
-            minWinBufs, MAX_CAM_BUFFERS - 1);
-
-    CALL_WIN(set_buffer_count, MAX_CAM_BUFFERS);
-
-    int w, h;
-    _parms.getPreviewSize(&w, &h);
-    CALL_WIN(set_usage, GRALLOC_USAGE_SW_WRITE_OFTEN);
-    CALL_WIN(set_buffers_geometry, w, h, HAL_PIXEL_FORMAT_YV12); // 3 plannar
+    status_t res = _setWindowGeometry(false);
+    if (res != NO_ERROR)
+        return res;
 
     if (_previewState == PREVIEW_PENDING) {
         LOGI("Starting pended preview...");
@@ -187,15 +269,230 @@ bool CameraHardware::msgTypeEnabled(int32_t msgType)
 
 // ---------------------------------------------------------------------------
 
-status_t CameraHardware::_fillWindow(const char* previewFrame,
-                                     int width, int height,
-                                     const char* strPixfmt)
+// Format of window buffers the sensor can capture into as they are, -1
+// if there is none. YV12 chroma lines are 16 byte aligned, so only
+// widths that leave no gaps will do.
+static int _directHalFormat(int pixfmt, int width)
+{
+    switch (pixfmt) {
+    case V4L2_PIX_FMT_NV21:
+        return HAL_PIXEL_FORMAT_YCrCb_420_SP;
+    case V4L2_PIX_FMT_YVU420:
+        return (width % 32) ? -1 : HAL_PIXEL_FORMAT_YV12;
+    default:
+        return -1;
+    }
+}
+
+// Window buffers needed: what the compositor holds back, plus one being
+// filled and one spare when frames are copied in, or a whole capture
+// buffer set when the sensor captures into them.
+int CameraHardware::_getWindowBufCnt(bool direct)
+{
+    int minWinBufs = 0;
+    if (_window->get_min_undequeued_buffer_count(_window, &minWinBufs)) {
+        LOGE("%s: Failed while run get_min_undequeued_buffer_count",
+             __func__);
+        return -1;
+    }
+
+    int n = minWinBufs + (direct ? PREVIEW_WIN_DIRECT_BUFS :
+                                   PREVIEW_WIN_SPARE_BUFS);
+    return n > MAX_CAM_BUFFERS ? MAX_CAM_BUFFERS : n;
+}
+
+status_t CameraHardware::_setWindowGeometry(bool direct)
+{
+    int bufCnt = _getWindowBufCnt(direct);
+    if (bufCnt < 0)
+        return UNKNOWN_ERROR;
+
+    int w, h;
+    _parms.getPreviewSize(&w, &h);
+
+    int usage = GRALLOC_USAGE_SW_WRITE_OFTEN;
+    int halFmt = HAL_PIXEL_FORMAT_YV12;    // 3 plannar
+    if (direct) {
+        usage |= GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_HW_CAMERA_WRITE;
+        halFmt = _directHalFormat(_camera->getPreviewPixfmt(), w);
+    }
+
+    CALL_WIN(set_buffer_count, bufCnt);
+    CALL_WIN(set_usage, usage);
+    CALL_WIN(set_buffers_geometry, w, h, halFmt);
+
+    _isWindowDirect = direct;
+    _winBufMax = bufCnt;
+
+    return NO_ERROR;
+}
+
+// Hand window buffers to the camera as its preview buffers, so frames
+// reach the display with no copy. Only when the window can show frames
+// in the format the sensor delivers; the window is left set up for
+// copying otherwise.
+status_t CameraHardware::_startDirectPreview(void)
+{
+    _camera->setPreviewUserBufs(0);
+
+    int w, h;
+    _parms.getPreviewSize(&w, &h);
+    int bufCnt = _getWindowBufCnt(true);
+    bool direct = bufCnt > 0 &&
+                  _directHalFormat(_camera->getPreviewPixfmt(), w) >= 0 &&
+                  _camera->setPreviewUserBufs(bufCnt) == 0;
+
+    if (!direct)
+        return _isWindowDirect ? _setWindowGeometry(false) : NO_ERROR;
+
+    status_t res = _setWindowGeometry(true);
+    for (int i = 0; res == NO_ERROR && i < PREVIEW_WIN_DIRECT_BUFS; i++) {
+        if (_dequeueWindowBuf() < 0)
+            res = UNKNOWN_ERROR;
+    }
+
+    if (res != NO_ERROR) {
+        LOGW("%s: window buffers can't be captured into. copying preview",
+             __func__);
+        _releaseWindowBufs();
+        _camera->setPreviewUserBufs(0);
+        return _setWindowGeometry(false);
+    }
+
+    return NO_ERROR;
+}
+
+// Take a window buffer for the camera to capture into. Returns its slot,
+// or -1 if the window has none or it doesn't hold a frame as the driver
+// writes it: packed lines, planes back to back.
+int CameraHardware::_dequeueWindowBuf(void)
+{
+    int w, h;
+    _camera->getPreviewFrameSize(&w, &h, NULL);
+
+    buffer_handle_t* buf = NULL;
+    int stride = 0;
+    if (_window->dequeue_buffer(_window, &buf, &stride) || buf == NULL) {
+        LOGE("%s: Failed to dequeue window buffer", __func__);
+        return -1;
+    }
+
+    unsigned int slot = 0;
+    while (slot < _winBufCnt && _winBufs[slot].handle != buf)
+        slot++;
+
+    if (slot >= _winBufMax || stride != w) {
+        LOGE("%s: window buffer doesn't fit. slot = %u, stride = %d",
+             __func__, slot, stride);
+        _window->cancel_buffer(_window, buf);
+        return -1;
+    }
+
+    _window->lock_buffer(_window, buf);
+
+    const Rect bounds(w, h);
+    GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+    void* vaddr[3];
+    int usage = GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_YUV_ADDR;
+    if (mapper.lock(*buf, usage, bounds, vaddr) != NO_ERROR) {
+        LOGE("%s: Failed to lock window buffer", __func__);
+        _window->cancel_buffer(_window, buf);
+        return -1;
+    }
+
+    struct winBuf* wb = &_winBufs[slot];
+    if (vaddr[1] != (char*)vaddr[0] + w * h) {
+        LOGE("%s: window buffer planes aren't contiguous", __func__);
+        mapper.unlock(*buf);
+        _window->cancel_buffer(_window, buf);
+        return -1;
+    }
+
+    if (slot == _winBufCnt) {
+        wb->handle = buf;
+        wb->vaddr = NULL;
+        _winBufCnt++;
+    }
+
+    if (wb->vaddr != vaddr[0]) {
+        if (_camera->setPreviewUserBuf(slot, vaddr[0], w * h * 3 / 2) < 0) {
+            mapper.unlock(*buf);
+            _window->cancel_buffer(_window, buf);
+            return -1;
+        }
+        wb->vaddr = vaddr[0];
+    }
+
+    wb->owned = true;
+
+    return slot;
+}
+
+// Show the frame captured into a window buffer, and give the camera
+// another buffer in its place.
+status_t CameraHardware::_postWindowBuf(int index)
+{
+    if (index < 0 || (unsigned int)index >= _winBufCnt ||
+        !_winBufs[index].owned) {
+        LOGE("%s: buffer-%d isn't a window buffer!", __func__, index);
+        return BAD_VALUE;
+    }
+
+    struct winBuf* wb = &_winBufs[index];
+    GraphicBufferMapper::get().unlock(*wb->handle);
+    wb->owned = false;
+    if (_window->enqueue_buffer(_window, wb->handle)) {
+        LOGE("%s: Failed to post buffer-%d", __func__, index);
+        _window->cancel_buffer(_window, wb->handle);
+    }
+    _winBufOwed++;
+
+    // retried on the next frame if the window has nothing to give yet
+    while (_winBufOwed) {
+        int slot = _dequeueWindowBuf();
+        if (slot < 0)
+            break;
+
+        _winBufOwed--;
+        _camera->qPreviewBuffer(slot);
+    }
+
+    return NO_ERROR;
+}
+
+// Give back the window buffers the camera still has. Only once the
+// preview stream is off, as the driver may be writing into them.
+void CameraHardware::_releaseWindowBufs(void)
+{
+    for (unsigned int i = 0; i < _winBufCnt; i++) {
+        struct winBuf* wb = &_winBufs[i];
+        if (!wb->owned)
+            continue;
+
+        GraphicBufferMapper::get().unlock(*wb->handle);
+        if (_window)
+            _window->cancel_buffer(_window, wb->handle);
+        wb->owned = false;
+    }
+
+    _winBufCnt = 0;
+    _winBufOwed = 0;
+}
+
+// Convert a preview frame in the driver's format into a YV12 window buffer.
+status_t CameraHardware::_fillWindow(const struct ccImage* src)
 {
     if (_window == NULL) {
         LOGE("%s: No window!", __func__);
         return UNKNOWN_ERROR;
     }
 
+    if (!_previewConv.canConvert()) {
+        LOGE("%s: Unsupported preview format, %d!", __func__,
+             _previewConv.srcFmt());
+        return UNKNOWN_ERROR;
+    }
+
     buffer_handle_t* buf = NULL;
     int stride = 0;
     CALL_WIN(dequeue_buffer, &buf, &stride);
@@ -204,7 +501,7 @@ status_t CameraHardware::_fillWindow(const char* previewFrame,
     //TODO: cancel_buffer when it failed!!
     CALL_WIN(lock_buffer, buf);
 
-    const Rect bounds(width, height);
+    const Rect bounds(_previewConv.width(), _previewConv.height());
     GraphicBufferMapper& grbuffer_mapper(GraphicBufferMapper::get());
 
     void* vaddr[3];
@@ -217,31 +514,15 @@ status_t CameraHardware::_fillWindow(const char* previewFrame,
         return UNKNOWN_ERROR;
     }
 
-    if (!strcmp(strPixfmt, CameraParameters::PIXEL_FORMAT_YUV420P)) {
-        const uint8* src_y = (const uint8*)previewFrame;
-        const uint8* src_v = src_y + (width * height);
-        const uint8* src_u = src_v + (width * height / 4);
-        libyuv::I420Copy(src_y, width,
-                         src_u, width / 2,
-                         src_v, width / 2,
-                         (uint8*)vaddr[0], stride,
-                         (uint8*)vaddr[1], stride / 2,
-                         (uint8*)vaddr[2], stride / 2,
-                         width, height);
-    } else if (!strcmp(strPixfmt, CameraParameters::PIXEL_FORMAT_YUV420SP)) {
-        const uint8* src_y = (const uint8*)previewFrame;
-        const uint8* src_uv = src_y + (width * height);
-        libyuv::NV12ToI420(src_y, width,
-                           src_uv, width,
-                           (uint8*)vaddr[0], stride,
-                           (uint8*)vaddr[1], stride / 2,
-                           (uint8*)vaddr[2], stride / 2,
-                           width, height);
-    } else {
-        LOGE("%s: Unsupported preview format, %s!", __func__, strPixfmt);
-        CALL_WIN(cancel_buffer, buf);
-        return UNKNOWN_ERROR;
-    }
+    // YV12 has Cr first, and chroma lines aligned to 16 bytes
+    struct ccImage dst;
+    dst.planes[0] = (uint8_t*)vaddr[0];
+    dst.planes[1] = (uint8_t*)vaddr[1];
+    dst.planes[2] = (uint8_t*)vaddr[2];
+    dst.strides[0] = stride;
+    dst.strides[1] = (stride / 2 + 15) & ~15;
+    dst.strides[2] = dst.strides[1];
+    _convertPool.convert(_previewConv, src, &dst);
 
     /* Show it. */
     CALL_WIN(enqueue_buffer, buf);
@@ -263,6 +544,8 @@ bool CameraHardware::_previewLoop()
 
     case PREVIEW_IDLE:
     case PREVIEW_PENDING:
+        // frames still being shown go back before the buffers go away
+        _presentQueue.drain();
         _camera->stopPreview();
 
         LOGI("%s: calling _camera->stopPreview() and waiting", __func__);
@@ -281,61 +564,302 @@ bool CameraHardware::_previewLoop()
     }
     _previewLock.unlock();
 
+    // Each node is serviced only when it has a frame, so a slow record
+    // node can't hold back preview and vice versa.
+    // 0 after a timeout, or when woken to look at _previewState again
+    int ready = _camera->waitStreams(PREVIEW_WAIT_TIMEOUT);
+    if (0 >= ready) {
+        LOGW_IF(ready < 0, "Is preview frame not readied?");
+        return true;
+    }
+
+    if (ready & CAMERA_STREAM_PREVIEW)
+        _capturePreviewFrame();
+
+    if (ready & CAMERA_STREAM_RECORD)
+        _handleRecordFrame();
+
+    return true;
+}
+
+// Dequeue a preview frame and hand it to the present thread, so a slow
+// window or callback doesn't keep the driver waiting for the next one.
+void CameraHardware::_capturePreviewFrame(void)
+{
     int index;
-    int ret = _camera->dqPreviewBuffer(&index, NULL, NULL);
+    SecV4L2FrameInfo info;
+    int ret = _camera->dqPreviewBuffer(&index, NULL, NULL, &info);
     if (0 > ret || 0 > index) {
         LOGW("Is preview frame not readied?");
-        return true;
+        return;
+    }
+
+    LOGV("preview frame #%u, captured %lldus ago", info.sequence,
+         ns2us(info.dqTime - info.timestamp));
+    _addLatency(&_previewLatency[LATENCY_CAPTURE_TO_DQ],
+                info.dqTime - info.timestamp);
+
+    if (!_presentQueue.push(index, &info)) {
+        LOGW("%s: present queue full, dropping frame #%u", __func__,
+             info.sequence);
+        _camera->qPreviewBuffer(index);
+    }
+}
+
+bool CameraHardware::_presentLoop()
+{
+    struct FrameQueue::frame f;
+    if (_presentQueue.wait(&f) < 0) {
+        LOGI("Exiting present thread...");
+        return false;
     }
 
-    nsecs_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    _handlePreviewFrame(f.index, &f.info);
+    _presentQueue.done();
 
+    return true;
+}
+
+void CameraHardware::_handlePreviewFrame(int index, const SecV4L2FrameInfo* info)
+{
+    struct ccImage planes;
+    _getPreviewPlanes(index, &planes);
+
+    // a window buffer is the window's once posted, so copy first
+    bool direct = _camera->isPreviewUserBufs();
+    bool notify = _cbData && (_msgs & CAMERA_MSG_PREVIEW_FRAME);
+    bool convert = notify && _callbackConv.canConvert();
+    if (convert)
+        _convertCallbackFrame(index, &planes);
+    else if (notify && (_camera->getPreviewPlaneCnt() > 1 || direct))
+        _packPreviewFrame(index, &planes);
+
+    nsecs_t displayTime = info->dqTime;
+    bool posted = false;
     if (_window) {
-        int w, h, frameSize;
-        _camera->getPreviewFrameSize(&w, &h, &frameSize);
-        int offset =  frameSize * index;
-        const char* preview_format = _parms.getPreviewFormat();
-        _fillWindow(((const char*)_previewHeap->data) + offset, w, h, preview_format);
+        if (direct) {
+            posted = _postWindowBuf(index) == NO_ERROR;
+        } else {
+            _fillWindow(&planes);
+        }
+
+        displayTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        _addLatency(&_previewLatency[LATENCY_DQ_TO_DISPLAY],
+                    displayTime - info->dqTime);
     }
 
-    _camera->qPreviewBuffer(index);
+    if (!posted)
+        _camera->qPreviewBuffer(index);
 
     // Notify the client of a new frame.
-    if (_cbData && (_msgs & CAMERA_MSG_PREVIEW_FRAME)) {
-        _cbData(CAMERA_MSG_PREVIEW_FRAME, _previewHeap, index, NULL, _cbCookie);
+    if (notify) {
+        unsigned int heapIdx = index;
+        camera_memory_t* heap = convert ? _callbackHeap :
+                                _getPreviewHeap(index, &heapIdx);
+        _cbData(CAMERA_MSG_PREVIEW_FRAME, heap, heapIdx, NULL, _cbCookie);
+
+        _addLatency(&_previewLatency[LATENCY_DISPLAY_TO_CALLBACK],
+                    systemTime(SYSTEM_TIME_MONOTONIC) - displayTime);
     }
+}
 
+void CameraHardware::_handleRecordFrame(void)
+{
     _previewLock.lock();
     if (_previewState != PREVIEW_RECORDING) {
         _previewLock.unlock();
-        return true;
+        return;
     }
     _previewLock.unlock();
 
-    unsigned int phyYAddr, phyCAddr;
-    ret = _camera->dqRecordBuffer(&index, &phyYAddr, &phyCAddr);
+    int index;
+    SecV4L2FrameInfo info;
+    int ret = _camera->dqRecordBuffer(&index, NULL, NULL, &info);
     if (0 > ret || 0 > index) {
         LOGW("Is record frame not readied?");
-        return true;
+        return;
     }
 
-    struct ADDRS* addrs     = (struct ADDRS*)_recordHeap->data;
-    addrs[index].type       = kMetadataBufferTypeCameraSource;
-    addrs[index].addr_y     = phyYAddr;
-    addrs[index].addr_cbcr  = phyCAddr;
-    addrs[index].buf_idx    = index;
+    _addLatency(&_recordLatency[LATENCY_CAPTURE_TO_DQ],
+                info.dqTime - info.timestamp);
 
     // Notify the client of a new frame.
     if (_cbDataWithTS && (_msgs & CAMERA_MSG_VIDEO_FRAME)) {
-        _cbDataWithTS(timestamp, CAMERA_MSG_VIDEO_FRAME,
+        _cbDataWithTS(info.timestamp, CAMERA_MSG_VIDEO_FRAME,
                       _recordHeap, index, _cbCookie);
+
+        _addLatency(&_recordLatency[LATENCY_DISPLAY_TO_CALLBACK],
+                    systemTime(SYSTEM_TIME_MONOTONIC) - info.dqTime);
     } else {
         _camera->qRecordBuffer(index);
     }
+}
 
-    return true;
+
+void CameraHardware::_addLatency(struct latencyStat* stat, nsecs_t latency)
+{
+    stat->count++;
+    stat->total += latency;
+    if (latency > stat->max)
+        stat->max = latency;
 }
 
+void CameraHardware::_dumpLatency(String8& result, const char* name,
+                                  const struct latencyStat* stats)
+{
+    static const char* stageNames[LATENCY_STAGE_MAX] = {
+        "capture->dqbuf",
+        "dqbuf->display",
+        "display->callback",
+    };
+
+    for (int i = 0; i < LATENCY_STAGE_MAX; i++) {
+        if (stats[i].count == 0)
+            continue;
+
+        result.appendFormat("  %s %s: frames=%u avg=%lldus max=%lldus\n",
+                            name, stageNames[i], stats[i].count,
+                            ns2us(stats[i].total / stats[i].count),
+                            ns2us(stats[i].max));
+    }
+}
+
+status_t CameraHardware::_allocPreviewHeaps(void)
+{
+    _releasePreviewHeaps();
+
+    unsigned int frameSize = _camera->getPreviewFrameSize();
+    int bufCnt = _camera->getPreviewBufCnt();
+
+    if (_callbackConv.canConvert()) {
+        size_t size = _callbackConv.width() * _callbackConv.height() * 3 / 2;
+        _callbackHeap = _cbReqMemory(-1, size, bufCnt, 0 /* no cookie */);
+        if (_callbackHeap == NULL)
+            return NO_MEMORY;
+    }
+
+    // Separate planes are mapped by the camera itself, and window buffers
+    // by gralloc. This heap only takes contiguous copies of them for the
+    // preview callback.
+    if (_camera->getPreviewPlaneCnt() > 1 || _camera->isPreviewUserBufs()) {
+        _previewHeap = _cbReqMemory(-1, frameSize, bufCnt,
+                                    0 /* no cookie */);
+        return _previewHeap ? NO_ERROR : NO_MEMORY;
+    }
+
+    // Map each buffer through its own dma-buf fd when the driver exports
+    // them. Otherwise fall back to mapping all buffers at once through the
+    // camera fd, which only works if the driver places them back to back.
+    if (_camera->getPreviewBufFd(0) >= 0) {
+        for (int i = 0; i < bufCnt; i++) {
+            int fd = _camera->getPreviewBufFd(i);
+            if (fd < 0)
+                break;
+
+            _previewBufHeaps[i] = _cbReqMemory(fd, frameSize, 1,
+                                               0 /* no cookie */);
+            if (_previewBufHeaps[i] == NULL) {
+                _releasePreviewHeaps();
+                return NO_MEMORY;
+            }
+        }
+
+        return NO_ERROR;
+    }
+
+    _previewHeap = _cbReqMemory(_camera->getFd(), frameSize,
+                                bufCnt, 0 /* no cookie */);
+
+    return _previewHeap ? NO_ERROR : NO_MEMORY;
+}
+
+void CameraHardware::_releasePreviewHeaps(void)
+{
+    if (_previewHeap) {
+        _previewHeap->release(_previewHeap);
+        _previewHeap = NULL;
+    }
+
+    if (_callbackHeap) {
+        _callbackHeap->release(_callbackHeap);
+        _callbackHeap = NULL;
+    }
+
+    for (int i = 0; i < MAX_CAM_BUFFERS; i++) {
+        if (_previewBufHeaps[i] == NULL)
+            continue;
+
+        _previewBufHeaps[i]->release(_previewBufHeaps[i]);
+        _previewBufHeaps[i] = NULL;
+    }
+}
+
+camera_memory_t* CameraHardware::_getPreviewHeap(int index,
+                                                 unsigned int* heapIdx)
+{
+    if (_previewBufHeaps[index]) {
+        *heapIdx = 0;
+        return _previewBufHeaps[index];
+    }
+
+    *heapIdx = index;
+    return _previewHeap;
+}
+
+const char* CameraHardware::_getPreviewFrame(int index)
+{
+    unsigned int heapIdx;
+    camera_memory_t* heap = _getPreviewHeap(index, &heapIdx);
+
+    return ((const char*)heap->data) + _camera->getPreviewFrameSize() * heapIdx;
+}
+
+// Planes of a preview frame and their strides. Frames in one buffer are
+// laid out by their format and line stride.
+void CameraHardware::_getPreviewPlanes(int index, struct ccImage* img)
+{
+    int planeCnt = _camera->getPreviewPlaneCnt();
+    void* starts[MAX_CAM_PLANES] = { NULL, NULL, NULL };
+    if (planeCnt > 1 || _camera->isPreviewUserBufs()) {
+        for (int p = 0; p < planeCnt && p < MAX_CAM_PLANES; p++)
+            _camera->getPreviewPlane(index, p, &starts[p], NULL);
+    } else {
+        starts[0] = (void*)_getPreviewFrame(index);
+    }
+
+    _previewConv.layout((uint8_t*)starts[0], img);
+
+    // separate planes are wherever the driver put them
+    for (int p = 1; p < planeCnt && p < MAX_CAM_PLANES; p++)
+        img->planes[p] = (uint8_t*)starts[p];
+}
+
+// Lay the planes of a preview buffer out back to back in _previewHeap,
+// as preview callbacks expect one contiguous frame.
+void CameraHardware::_packPreviewFrame(int index, const struct ccImage* img)
+{
+    char* dst = (char*)_previewHeap->data +
+                _camera->getPreviewFrameSize() * index;
+
+    for (int p = 0; p < _camera->getPreviewPlaneCnt(); p++) {
+        size_t size = 0;
+        _camera->getPreviewPlane(index, p, NULL, &size);
+        memcpy(dst, img->planes[p], size);
+        dst += size;
+    }
+}
+
+// Convert a preview frame into its slot of _callbackHeap, in one pass.
+void CameraHardware::_convertCallbackFrame(int index, const struct ccImage* img)
+{
+    int w = _callbackConv.width();
+    int h = _callbackConv.height();
+    uint8_t* dst = (uint8_t*)_callbackHeap->data + w * h * 3 / 2 * index;
+
+    struct ccImage cb;
+    ccLayout(_callbackConv.dstFmt(), dst, w, h, 0, &cb);
+    _convertPool.convert(_callbackConv, img, &cb);
+}
 
 status_t CameraHardware::_startPreviewLocked()
 {
@@ -346,21 +870,49 @@ status_t CameraHardware::_startPreviewLocked()
         return UNKNOWN_ERROR;
     }
 
+    memset(_previewLatency, 0, sizeof(_previewLatency));
+    memset(_recordLatency, 0, sizeof(_recordLatency));
+
+    // copies into the window if the sensor can't capture into it
+    _startDirectPreview();
+
+    _camera->setPreviewHeld(PREVIEW_PRESENT_HELD);
     int ret  = _camera->startPreview();
     if (ret < 0) {
         LOGE("ERR(%s):Fail on mSecCamera->startPreview()", __func__);
+        _releaseWindowBufs();
         return UNKNOWN_ERROR;
     }
 
-    if (_previewHeap)
-        _previewHeap->release(_previewHeap);
+    if (_winBufCnt && !_camera->isPreviewUserBufs()) {
+        // the driver wouldn't take them. none of them is queued
+        _releaseWindowBufs();
+        _camera->setPreviewUserBufs(0);
+        _setWindowGeometry(false);
+    }
 
-    _previewHeap = _cbReqMemory(_camera->getFd(),
-                                _camera->getPreviewFrameSize(),
-                                MAX_CAM_BUFFERS, 0 /* no cookie */);
-    if (_previewHeap == NULL) {
+    // the format, size and stride are set for as long as preview runs.
+    // frames may be captured larger and halved while being converted
+    int w, h;
+    _camera->getPreviewFrameSize(&w, &h, NULL);
+    int shift = _camera->getPreviewShift();
+    _previewConv.init(_camera->getPreviewPixfmt(), V4L2_PIX_FMT_YVU420,
+                      w << shift, h << shift, _camera->getPreviewStride(),
+                      shift);
+
+    // and callbacks get them in the format they asked for, if the driver
+    // captures in another
+    _callbackConv.reset();
+    if (_camera->getPreviewCbPixfmt() != _camera->getPreviewPixfmt())
+        _callbackConv.init(_camera->getPreviewPixfmt(),
+                           _camera->getPreviewCbPixfmt(),
+                           w << shift, h << shift,
+                           _camera->getPreviewStride(), shift);
+
+    if (_allocPreviewHeaps() != NO_ERROR) {
         LOGE("%s: Failed to request memory for preview!", __func__);
         _camera->stopPreview();
+        _releaseWindowBufs();
         return NO_MEMORY;
     }
 
@@ -372,7 +924,9 @@ status_t CameraHardware::_startPreviewLocked()
 
 status_t CameraHardware::startPreview()
 {
-    if (_waitPictureComplete() != NO_ERROR) {
+    // a capture on the side node doesn't touch the preview node
+    if (_captureMode != CAPTURE_SIDE_NODE &&
+        _waitPictureComplete() != NO_ERROR) {
         LOGE("%s: Too long wait for capture finish!", __func__);
         return TIMED_OUT;
     }
@@ -403,11 +957,15 @@ void CameraHardware::_stopPreviewLocked()
         return;
     }
 
-    // request that the preview thread stop.
+    // request that the preview thread stop, waking it if it is still
+    // waiting for a frame.
     _previewState = PREVIEW_IDLE;
     _previewStateChangedCondition.signal();
+    _camera->cancelWaits();
     // wait until preview thread is stopped.
     _previewStoppedCondition.wait(_previewLock);
+
+    _releaseWindowBufs();
 }
 
 void CameraHardware::stopPreview()
@@ -438,18 +996,36 @@ status_t CameraHardware::startRecording()
         return UNKNOWN_ERROR;
     }
 
+    if (_camera->startRecord() < 0) {
+        LOGE("ERR(%s):Fail on _camera->startRecord()", __func__);
+        return UNKNOWN_ERROR;
+    }
+
+    // one entry per record buffer, as many as the camera set up
+    int bufCnt = _camera->getRecordBufCnt();
     if (_recordHeap)
         _recordHeap->release(_recordHeap);
-    _recordHeap = _cbReqMemory(-1, sizeof(struct ADDRS), MAX_CAM_BUFFERS, NULL);
+    _recordHeap = _cbReqMemory(-1, sizeof(struct ADDRS), bufCnt, NULL);
     if (_recordHeap == NULL) {
         LOGE("ERR(%s): Record heap creation fail", __func__);
+        _camera->stopRecord();
         return NO_MEMORY;
     }
 
-    if (_camera->startRecord() < 0) {
-        LOGE("ERR(%s):Fail on _camera->startRecord()", __func__);
-        return UNKNOWN_ERROR;
+    // buffer addresses don't change while recording. describe every
+    // buffer once here rather than per frame
+    struct ADDRS* addrs = (struct ADDRS*)_recordHeap->data;
+    for (int i = 0; i < bufCnt; i++) {
+        addrs[i].type       = kMetadataBufferTypeCameraSource;
+        addrs[i].buf_idx    = i;
+        addrs[i].buf_fd     = _camera->getRecordBufFd(i);
+        if (_camera->getRecordAddr(i, &addrs[i].addr_y,
+                                   &addrs[i].addr_cbcr) < 0) {
+            addrs[i].addr_y = 0;
+            addrs[i].addr_cbcr = 0;
+        }
     }
+
     _previewState = PREVIEW_RECORDING;
 
     return NO_ERROR;
@@ -573,19 +1149,19 @@ bool CameraHardware::_pictureLoop()
     _pictureState = PICTURE_CAPTURING;
     _pictureStateChangedCondition.broadcast();
 
+    if (_camera->getBurstCount() > 1) {
+        ret = _captureBurst();
+        goto out;
+    }
+
     LOGV("doing snapshot...");
-    ret = _camera->startSnapshot(&rawSize);
+    ret = _camera->startSnapshot(&rawSize, _shutterTime);
     if (ret != 0) {
         LOGE("%s: Failed to do snapshot!", __func__);
         ret = UNKNOWN_ERROR;
         goto out;
     }
 
-    if (_cbNotify && (_msgs & CAMERA_MSG_SHUTTER))
-        _cbNotify(CAMERA_MSG_SHUTTER, 0, 0, _cbCookie);
-
-    _camera->getSnapshot();
-
     if (_rawHeap == NULL || _rawHeap->size != rawSize) {
         LOGV("allocating mem (%d bytes) for raw snapshot...", rawSize);
         if (_rawHeap != NULL)
@@ -599,8 +1175,16 @@ bool CameraHardware::_pictureLoop()
         }
     }
 
-    LOGV("getting raw snapshot...");
+    // let the sensor write into the raw heap directly if it can
     rawAddr = (uint8_t*)_rawHeap->data;
+    _camera->setSnapshotBuffer(rawAddr, rawSize);
+
+    if (_cbNotify && (_msgs & CAMERA_MSG_SHUTTER))
+        _cbNotify(CAMERA_MSG_SHUTTER, 0, 0, _cbCookie);
+
+    _camera->getSnapshot();
+
+    LOGV("getting raw snapshot...");
     _camera->getRawSnapshot(rawAddr, rawSize);
 
     if (_cbData && (_msgs & CAMERA_MSG_RAW_IMAGE)) {
@@ -636,6 +1220,141 @@ out:
     return false;
 }
 
+// Frames are captured here and encoded on _encodeThread, so the sensor
+// fills frame k+1 while frame k is compressed. A buffer goes back to the
+// sensor once its JPEG is delivered.
+status_t CameraHardware::_captureBurst(void)
+{
+    size_t rawSize = 0;
+    if (_camera->startSnapshot(&rawSize, _shutterTime) != 0) {
+        LOGE("%s: Failed to start burst!", __func__);
+        return UNKNOWN_ERROR;
+    }
+
+    if (_cbNotify && (_msgs & CAMERA_MSG_SHUTTER))
+        _cbNotify(CAMERA_MSG_SHUTTER, 0, 0, _cbCookie);
+
+    _burstLock.lock();
+    _burstQueueCnt = 0;
+    _burstDone = false;
+    _burstDelivered = 0;
+    _burstLock.unlock();
+
+    _encodeThread = new EncodeThread(this);
+    if (_encodeThread->startLoop() != NO_ERROR) {
+        LOGE("%s: couldn't run encode thread", __func__);
+        _encodeThread.clear();
+        return UNKNOWN_ERROR;
+    }
+
+    int count = _camera->getBurstCount();
+    nsecs_t start = 0;
+    for (int i = 0; i < count; i++) {
+        int index = _camera->getBurstFrame(NULL);
+        if (index < 0) {
+            LOGE("%s: lost frame %d of %d (%d)", __func__, i, count, index);
+            break;
+        }
+
+        if (i == 0)
+            start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        // at most one entry per buffer is ever queued
+        Mutex::Autolock lock(_burstLock);
+        _burstQueue[_burstQueueCnt++] = index;
+        _burstCondition.signal();
+    }
+
+    _burstLock.lock();
+    _burstDone = true;
+    _burstCondition.signal();
+    _burstLock.unlock();
+
+    _encodeThread->requestExitAndWait();
+    _encodeThread.clear();
+
+    unsigned int delivered = _burstDelivered;
+    if (delivered && _burstLastDelivery > start) {
+        _burstStat.bursts++;
+        _burstStat.frames += delivered;
+        _burstStat.lastFrames = delivered;
+        _burstStat.lastElapsed = _burstLastDelivery - start;
+        _burstStat.elapsed += _burstStat.lastElapsed;
+    }
+
+    LOGI("%s: %u of %d pictures delivered", __func__, delivered, count);
+
+    return delivered == (unsigned int)count ? NO_ERROR : UNKNOWN_ERROR;
+}
+
+bool CameraHardware::_encodeLoop()
+{
+    _burstLock.lock();
+    while (_burstQueueCnt == 0 && !_burstDone)
+        _burstCondition.wait(_burstLock);
+
+    if (_burstQueueCnt == 0) {
+        _burstLock.unlock();
+        return false;
+    }
+
+    int index = _burstQueue[0];
+    memmove(&_burstQueue[0], &_burstQueue[1],
+            sizeof(_burstQueue[0]) * --_burstQueueCnt);
+    _burstLock.unlock();
+
+    uint8_t* data = NULL;
+    size_t size = 0;
+    if (_cbData && (_msgs & CAMERA_MSG_COMPRESSED_IMAGE) &&
+        _camera->getBurstFrameData(index, &data, &size) == 0) {
+        int jpegSize = _camera->compressToJpeg(data, size);
+        camera_memory_t* jpegHeap = _cbReqMemory(-1, jpegSize, 1, 0);
+        if (jpegHeap) {
+            _camera->writeJpeg((uint8_t*)jpegHeap->data, jpegSize);
+            _cbData(CAMERA_MSG_COMPRESSED_IMAGE, jpegHeap, 0, NULL, _cbCookie);
+            jpegHeap->release(jpegHeap);
+
+            _burstDelivered++;
+            _burstLastDelivery = systemTime(SYSTEM_TIME_MONOTONIC);
+        } else {
+            LOGE("%s: Failed to get memory for jpegJeap!", __func__);
+        }
+    }
+
+    _camera->releaseBurstFrame(index);
+
+    return true;
+}
+
+// Settings a capture in flight reads: size and format of the picture,
+// encoding and the exif rotation.
+bool CameraHardware::_isPictureParamUpdated(const CameraParameters& parms) const
+{
+    static const char* keys[] = {
+        CameraParameters::KEY_PICTURE_SIZE,
+        CameraParameters::KEY_PICTURE_FORMAT,
+        CameraParameters::KEY_JPEG_QUALITY,
+        CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH,
+        CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT,
+        CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY,
+        CameraParameters::KEY_ROTATION,
+        KEY_BURST_COUNT,
+        KEY_ZSL,
+    };
+
+    for (unsigned int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        const char* newValue = parms.get(keys[i]);
+        const char* value = _parms.get(keys[i]);
+        if (newValue == value)
+            continue;
+
+        if (newValue == NULL || value == NULL || strcmp(newValue, value))
+            return true;
+    }
+
+    return false;
+}
+
 status_t CameraHardware::_waitPictureComplete()
 {
     Mutex::Autolock lock(_pictureLock);
@@ -656,7 +1375,17 @@ status_t CameraHardware::_waitPictureComplete()
 
 status_t CameraHardware::takePicture()
 {
-    stopPreview();
+    // with zero shutter lag the picture comes from a frame preview has
+    // captured already, and preview keeps running
+    _shutterTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (_camera->isZslCapture()) {
+        _captureMode = CAPTURE_ZSL;
+    } else if (_camera->isSideCapture()) {
+        _captureMode = CAPTURE_SIDE_NODE;
+    } else {
+        _captureMode = CAPTURE_STOP_PREVIEW;
+        stopPreview();
+    }
 
     if (_waitPictureComplete() != NO_ERROR) {
         LOGE("%s: Too long wait for capture finish!", __func__);
@@ -728,8 +1457,11 @@ status_t CameraHardware::setParameters(const CameraParameters& parms, bool needI
     /* if someone calls us while picture thread is running, it could screw
      * up the sensor quite a bit so return error.  we can't wait because
      * that would cause deadlock with the callbacks
+     * captures that leave preview running only mind the picture settings.
      */
-    if (!needInit && _waitPictureComplete() != NO_ERROR) {
+    bool waitPicture = _captureMode == CAPTURE_STOP_PREVIEW ||
+                       _isPictureParamUpdated(parms);
+    if (!needInit && waitPicture && _waitPictureComplete() != NO_ERROR) {
         LOGE("%s: Too long wait for capture finish!", __func__);
         return TIMED_OUT;
     }
@@ -764,6 +1496,25 @@ status_t CameraHardware::setParameters(const CameraParameters& parms, bool needI
         }
     }
 
+    // burst-count
+    strKey = KEY_BURST_COUNT;
+    int burstCount = parms.getInt(strKey);
+    if (burstCount > 0 && (needInit || _isParamUpdated(parms, strKey, burstCount))) {
+        LOGV("setting %s to %d...", strKey, burstCount);
+        err = _camera->setBurstCount(burstCount);
+        if (!err)
+            _parms.set(strKey, burstCount);
+    }
+
+    // zsl. applies from the next preview start
+    strKey = KEY_ZSL;
+    const char* strZsl = parms.get(strKey);
+    if (strZsl && (needInit || _isParamUpdated(parms, strKey, strZsl))) {
+        err = _camera->setZsl(!strcmp(strZsl, "on"));
+        if (!needInit && !err)
+            _parms.set(strKey, strZsl);
+    }
+
     // jpeg-thumbnail-width and jpeg-thumbnail-height
     width  = parms.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
     height = parms.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
@@ -810,6 +1561,9 @@ status_t CameraHardware::setParameters(const CameraParameters& parms, bool needI
             _parms.set(strKey, rot);
     }
 
+    // sensor controls below go to the driver in one go
+    _camera->beginParams();
+
     // flash-mode
     strKey = CameraParameters::KEY_FLASH_MODE;
     const char* strFlashMode = parms.get(strKey);
@@ -860,15 +1614,16 @@ status_t CameraHardware::setParameters(const CameraParameters& parms, bool needI
             _parms.set(strKey, nEv);
     }
 
+    if (_camera->commitParams())
+        err = -1;
+
     // frame rate
     int new_frame_rate = parms.getPreviewFrameRate();
     if (new_frame_rate < 5 || new_frame_rate > 30)
         new_frame_rate = 30;
 
     _parms.setPreviewFrameRate(new_frame_rate);
-#if 0
     _camera->setFrameRate(new_frame_rate);
-#endif
 
     // fps range
     // TODO: need codes for fps range
@@ -907,11 +1662,19 @@ void CameraHardware::release()
         _previewLock.lock();
         _previewState = PREVIEW_ABORT;
         _previewStateChangedCondition.signal();
+        _camera->cancelWaits();
         _previewLock.unlock();
         _previewThread->requestExitAndWait();
         _previewThread.clear();
     }
 
+    if (_presentThread != NULL) {
+        _presentQueue.abort();
+        _presentThread->requestExitAndWait();
+        _presentThread.clear();
+    }
+    _convertPool.stop();
+
     if (_focusThread != NULL) {
         /* this thread is normally already in it's threadLoop but blocked
          * on the condition variable.  signal it so it wakes up and can exit.
@@ -929,15 +1692,21 @@ void CameraHardware::release()
         _pictureThread.clear();
     }
 
+    if (_monitorThread != NULL) {
+        _monitorLock.lock();
+        _monitorExit = true;
+        _monitorCondition.signal();
+        _monitorLock.unlock();
+        _monitorThread->requestExitAndWait();
+        _monitorThread.clear();
+    }
+
     // release heaps
     if (_rawHeap) {
         _rawHeap->release(_rawHeap);
         _rawHeap = NULL;
     }
-    if (_previewHeap) {
-        _previewHeap->release(_previewHeap);
-        _previewHeap = NULL;
-    }
+    _releasePreviewHeaps();
     if (_recordHeap) {
         _recordHeap->release(_recordHeap);
         _recordHeap = NULL;
@@ -950,11 +1719,75 @@ void CameraHardware::release()
         delete _camera;
         _camera = NULL;
     }
+    _releaseWindowBufs();
+}
+
+// Drop counters are sampled here rather than on the preview thread.
+// The preview lock isn't taken: SecCamera guards its streams itself,
+// so the G_CTRLs only hold up a start or stop of preview, not a frame.
+bool CameraHardware::_monitorLoop()
+{
+    _monitorLock.lock();
+    if (!_monitorExit)
+        _monitorCondition.waitRelative(_monitorLock,
+                                       ms2ns(_camera->getDropInterval()));
+    bool exit = _monitorExit;
+    _monitorLock.unlock();
+    if (exit)
+        return false;
+
+    _camera->sampleDrops();
+
+    return true;
+}
+
+void CameraHardware::_dropCallback(void* user, const char* stream,
+                                   unsigned int permille)
+{
+    CameraHardware* hw = (CameraHardware*)user;
+
+    hw->_dropAlarms++;
+    hw->_lastDropStream = stream;
+    hw->_lastDropPermille = permille;
 }
 
 status_t CameraHardware::dump(int fd) const
 {
-    // TODO: fill dump!
+    String8 result;
+
+    result.appendFormat("CameraHardware %d:\n", _cameraId);
+    _dumpLatency(result, "preview", _previewLatency);
+    _dumpLatency(result, "record", _recordLatency);
+    _presentQueue.dump(result, "present");
+    _convertPool.dump(result);
+    if (_burstStat.bursts) {
+        result.appendFormat("  burst: %u bursts, sustained %.1ffps, "
+                            "last %u frames in %lldms\n",
+                            _burstStat.bursts,
+                            _burstStat.elapsed ? _burstStat.frames * 1e9 /
+                                                 _burstStat.elapsed : 0.0,
+                            _burstStat.lastFrames,
+                            ns2ms(_burstStat.lastElapsed));
+    }
+    if (_callbackConv.canConvert()) {
+        unsigned int src = _callbackConv.srcFmt();
+        unsigned int dst = _callbackConv.dstFmt();
+        result.appendFormat("  callbacks: %.4s, captured as %.4s\n",
+                            (const char*)&dst, (const char*)&src);
+    }
+    if (_isWindowDirect) {
+        result.appendFormat("  window: direct, %u/%u buffers, %u owed\n",
+                            _winBufCnt, _winBufMax, _winBufOwed);
+    }
+    if (_dropAlarms) {
+        result.appendFormat("  drop alarms: %u, last %s at %u.%u%%\n",
+                            _dropAlarms, _lastDropStream,
+                            _lastDropPermille / 10, _lastDropPermille % 10);
+    }
+    if (_camera)
+        _camera->dump(result);
+
+    write(fd, result.string(), result.size());
 
     return NO_ERROR;
 }
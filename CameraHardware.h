@@ -18,6 +18,9 @@
 #define __ANDROID_HARDWARE_LIBCAMERA_CAMERA_HARDWARE_H__
 
 #include "SecCamera.h"
+#include "ColorConvert.h"
+#include "FrameQueue.h"
+#include "ConvertPool.h"
 #include <hardware/camera.h>
 #include <camera/CameraParameters.h>
 #include <utils/threads.h>
@@ -72,6 +75,9 @@ private:
 
     int32_t             _msgs;
     camera_memory_t*    _previewHeap;
+    camera_memory_t*    _previewBufHeaps[MAX_CAM_BUFFERS];
+    // linear copies of frames captured in a format callbacks don't take
+    camera_memory_t*    _callbackHeap;
     camera_memory_t*    _rawHeap;
     camera_memory_t*    _recordHeap;
 
@@ -84,6 +90,8 @@ private:
 
     CameraParameters    _parms;
     void                _initParams(void);
+    void                _setSupportedValues(const char* key, const char* valuesKey,
+                                            const String8& values);
     bool                _isParamUpdated(const CameraParameters& newParams,
                                         const char* key,
                                         const char* newValue) const;
@@ -91,10 +99,48 @@ private:
                                         const char* key,
                                         int newValue) const;
 
+    // per-frame latency, accounted on the preview thread. when there is
+    // no window to display on, the display stage takes no time.
+    enum latencyStage {
+        LATENCY_CAPTURE_TO_DQ = 0,
+        LATENCY_DQ_TO_DISPLAY,
+        LATENCY_DISPLAY_TO_CALLBACK,
+        LATENCY_STAGE_MAX
+    };
+    struct latencyStat {
+        unsigned int count;
+        nsecs_t total;
+        nsecs_t max;
+    };
+    struct latencyStat  _previewLatency[LATENCY_STAGE_MAX];
+    struct latencyStat  _recordLatency[LATENCY_STAGE_MAX];
+    static void         _addLatency(struct latencyStat* stat, nsecs_t latency);
+    static void         _dumpLatency(String8& result, const char* name,
+                                     const struct latencyStat* stats);
+
     preview_stream_ops* _window;
-    status_t            _fillWindow(const char* previewFrame,
-                                    int width, int height,
-                                    const char* strPixfmt);
+    int                 _getWindowBufCnt(bool direct);
+    status_t            _setWindowGeometry(bool direct);
+    status_t            _fillWindow(const struct ccImage* src);
+
+    // direct preview. the sensor captures into window buffers; slot i
+    // is capture buffer i. a slot is owned from dequeue_buffer() until
+    // it is posted, and _winBufOwed counts the posted ones not yet
+    // replaced by another dequeue_buffer()
+    struct winBuf {
+        buffer_handle_t* handle;
+        void* vaddr;
+        bool owned;
+    };
+    bool                _isWindowDirect;
+    struct winBuf       _winBufs[MAX_CAM_BUFFERS];
+    unsigned int        _winBufCnt;
+    unsigned int        _winBufMax;
+    unsigned int        _winBufOwed;
+    status_t            _startDirectPreview(void);
+    int                 _dequeueWindowBuf(void);
+    status_t            _postWindowBuf(int index);
+    void                _releaseWindowBufs(void);
 
 #define DEFINE_THREAD(N, P, L)                                  \
     bool L();                                                   \
@@ -120,8 +166,30 @@ private:
     mutable Condition   _previewStateChangedCondition;
     mutable Condition   _previewStoppedCondition;
     mutable Mutex       _previewLock;
+    void                _capturePreviewFrame(void);
+    void                _handlePreviewFrame(int index, const SecV4L2FrameInfo* info);
+    void                _handleRecordFrame(void);
+
+    // the preview thread only dequeues frames. this one shows them and
+    // calls back with them, then gives the buffers back
+    DEFINE_THREAD(PresentThread, PRIORITY_URGENT_DISPLAY, _presentLoop);
+    sp<PresentThread>   _presentThread;
+    FrameQueue          _presentQueue;
     status_t            _startPreviewLocked(void);
     void                _stopPreviewLocked(void);
+    status_t            _allocPreviewHeaps(void);
+    void                _releasePreviewHeaps(void);
+    camera_memory_t*    _getPreviewHeap(int index, unsigned int* heapIdx);
+    const char*         _getPreviewFrame(int index);
+    void                _getPreviewPlanes(int index, struct ccImage* img);
+    // preview frames into window buffers, set up by _startPreviewLocked()
+    ccConverter         _previewConv;
+    ccConverter         _callbackConv;
+    // runs both, in bands across cores
+    ConvertPool         _convertPool;
+    void                _convertCallbackFrame(int index,
+                                              const struct ccImage* img);
+    void                _packPreviewFrame(int index, const struct ccImage* img);
 
     DEFINE_THREAD(FocusThread, PRIORITY_DEFAULT, _focusLoop);
     sp<FocusThread> _focusThread;
@@ -147,9 +215,51 @@ private:
         PICTURE_INVALID
     };
     enum pictureState   _pictureState;
+    nsecs_t             _shutterTime;
+    // how the last takePicture() gets its frame
+    enum captureMode {
+        CAPTURE_STOP_PREVIEW = 0,   // preview stops, sensor is reconfigured
+        CAPTURE_ZSL,                // from frames preview captured already
+        CAPTURE_SIDE_NODE,          // on another node, preview keeps going
+    };
+    enum captureMode    _captureMode;
     mutable Condition   _pictureStateChangedCondition;
     mutable Mutex       _pictureLock;
     status_t            _waitPictureComplete(void);
+    bool                _isPictureParamUpdated(const CameraParameters& parms) const;
+
+    // burst. the picture thread captures, this one encodes and delivers
+    // frames in the order they were queued, then gives them back.
+    DEFINE_THREAD(EncodeThread, PRIORITY_DEFAULT, _encodeLoop);
+    sp<EncodeThread>    _encodeThread;
+    int                 _burstQueue[MAX_CAM_BUFFERS];
+    unsigned int        _burstQueueCnt;
+    bool                _burstDone;
+    mutable Condition   _burstCondition;
+    mutable Mutex       _burstLock;
+    status_t            _captureBurst(void);
+    struct burstStat {
+        unsigned int bursts;
+        unsigned int frames;
+        nsecs_t elapsed;        // first frame captured to last delivered
+        unsigned int lastFrames;
+        nsecs_t lastElapsed;
+    };
+    struct burstStat    _burstStat;
+    unsigned int        _burstDelivered;
+    nsecs_t             _burstLastDelivery;
+
+    // samples frame drop counters while previewing
+    DEFINE_THREAD(MonitorThread, PRIORITY_BACKGROUND, _monitorLoop);
+    sp<MonitorThread>   _monitorThread;
+    bool                _monitorExit;
+    mutable Condition   _monitorCondition;
+    mutable Mutex       _monitorLock;
+    unsigned int        _dropAlarms;
+    unsigned int        _lastDropPermille;
+    const char*         _lastDropStream;
+    static void         _dropCallback(void* user, const char* stream,
+                                      unsigned int permille);
 
 #undef DEFINE_THREAD
 
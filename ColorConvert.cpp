@@ -0,0 +1,741 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConvert"
+#include <utils/Log.h>
+
+#include <string.h>
+#include <linux/videodev2.h>
+#include "videodev2_samsung.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ColorConvert.h"
+
+namespace android {
+
+// ======================================================================
+// Line kernels. Each does the bulk of a line with NEON or SSE2 where the
+// build has it, and the rest of the line in C.
+
+// interleaved pairs into two planes. swapping a and b splits NV21
+static void _splitPairs(const uint8_t* src, uint8_t* a, uint8_t* b, int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t p = vld2q_u8(src + i * 2);
+        vst1q_u8(a + i, p.val[0]);
+        vst1q_u8(b + i, p.val[1]);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    for (; i + 16 <= n; i += 16) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+        _mm_storeu_si128((__m128i*)(a + i),
+                         _mm_packus_epi16(_mm_and_si128(p0, mask),
+                                          _mm_and_si128(p1, mask)));
+        _mm_storeu_si128((__m128i*)(b + i),
+                         _mm_packus_epi16(_mm_srli_epi16(p0, 8),
+                                          _mm_srli_epi16(p1, 8)));
+    }
+#endif
+    for (; i < n; i++) {
+        a[i] = src[i * 2];
+        b[i] = src[i * 2 + 1];
+    }
+}
+
+// two planes into interleaved pairs, a first
+static void _mergePairs(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t p;
+        p.val[0] = vld1q_u8(a + i);
+        p.val[1] = vld1q_u8(b + i);
+        vst2q_u8(dst + i * 2, p);
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), _mm_unpacklo_epi8(va, vb));
+        _mm_storeu_si128((__m128i*)(dst + i * 2 + 16),
+                         _mm_unpackhi_epi8(va, vb));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i * 2] = a[i];
+        dst[i * 2 + 1] = b[i];
+    }
+}
+
+// NV12 chroma into NV21 chroma and back
+static void _swapPairs(const uint8_t* src, uint8_t* dst, int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t p = vld2q_u8(src + i * 2);
+        uint8x16_t t = p.val[0];
+        p.val[0] = p.val[1];
+        p.val[1] = t;
+        vst2q_u8(dst + i * 2, p);
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dst + i * 2),
+                         _mm_or_si128(_mm_slli_epi16(p, 8),
+                                      _mm_srli_epi16(p, 8)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i * 2] = src[i * 2 + 1];
+        dst[i * 2 + 1] = src[i * 2];
+    }
+}
+
+// rounded average of two lines, for 4:2:2 chroma to 4:2:0
+static void _avgLines(const uint8_t* a, const uint8_t* b, uint8_t* dst, int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16)
+        vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+#elif defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_avg_epu8(va, vb));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (a[i] + b[i] + 1) >> 1;
+}
+
+static void _yuyvToY(const uint8_t* src, uint8_t* y, int w)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= w; i += 16)
+        vst1q_u8(y + i, vld2q_u8(src + i * 2).val[0]);
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    for (; i + 16 <= w; i += 16) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+        _mm_storeu_si128((__m128i*)(y + i),
+                         _mm_packus_epi16(_mm_and_si128(p0, mask),
+                                          _mm_and_si128(p1, mask)));
+    }
+#endif
+    for (; i < w; i++)
+        y[i] = src[i * 2];
+}
+
+// chroma of two yuyv lines, averaged
+static void _yuyvToUV(const uint8_t* src0, const uint8_t* src1,
+                      uint8_t* u, uint8_t* v, int w)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= w; i += 16) {
+        uint8x8x4_t p0 = vld4_u8(src0 + i * 2);
+        uint8x8x4_t p1 = vld4_u8(src1 + i * 2);
+        vst1_u8(u + i / 2, vrhadd_u8(p0.val[1], p1.val[1]));
+        vst1_u8(v + i / 2, vrhadd_u8(p0.val[3], p1.val[3]));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    for (; i + 16 <= w; i += 16) {
+        __m128i a = _mm_avg_epu8(
+            _mm_loadu_si128((const __m128i*)(src0 + i * 2)),
+            _mm_loadu_si128((const __m128i*)(src1 + i * 2)));
+        __m128i b = _mm_avg_epu8(
+            _mm_loadu_si128((const __m128i*)(src0 + i * 2 + 16)),
+            _mm_loadu_si128((const __m128i*)(src1 + i * 2 + 16)));
+        // UV pairs in the odd bytes, then U and V apart
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                      _mm_srli_epi16(b, 8));
+        __m128i zero = _mm_setzero_si128();
+        _mm_storel_epi64((__m128i*)(u + i / 2),
+                         _mm_packus_epi16(_mm_and_si128(uv, mask), zero));
+        _mm_storel_epi64((__m128i*)(v + i / 2),
+                         _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+#endif
+    for (; i + 1 < w; i += 2) {
+        u[i / 2] = (src0[i * 2 + 1] + src1[i * 2 + 1] + 1) >> 1;
+        v[i / 2] = (src0[i * 2 + 3] + src1[i * 2 + 3] + 1) >> 1;
+    }
+}
+
+// BT.601 limited range
+#define RGB_TO_Y(r, g, b)   ((((r) * 66 + (g) * 129 + (b) * 25 + 128) >> 8) + 16)
+#define RGB_TO_U(r, g, b)   ((((r) * -38 - (g) * 74 + (b) * 112 + 128) >> 8) + 128)
+#define RGB_TO_V(r, g, b)   ((((r) * 112 - (g) * 94 - (b) * 18 + 128) >> 8) + 128)
+
+static inline void _unpack565(uint16_t p, int* r, int* g, int* b)
+{
+    *r = ((p >> 11) << 3) | (p >> 13);
+    *g = (((p >> 5) & 0x3f) << 2) | ((p >> 9) & 0x3);
+    *b = ((p & 0x1f) << 3) | ((p >> 2) & 0x7);
+}
+
+static void _rgb565ToY(const uint8_t* src, uint8_t* y, int w)
+{
+    const uint16_t* p = (const uint16_t*)src;
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= w; i += 8) {
+        uint16x8_t px = vld1q_u16(p + i);
+        uint16x8_t r = vshrq_n_u16(px, 11);
+        uint16x8_t g = vandq_u16(vshrq_n_u16(px, 5), vdupq_n_u16(0x3f));
+        uint16x8_t b = vandq_u16(px, vdupq_n_u16(0x1f));
+        r = vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2));
+        g = vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4));
+        b = vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2));
+        uint16x8_t acc = vmulq_n_u16(r, 66);
+        acc = vmlaq_n_u16(acc, g, 129);
+        acc = vmlaq_n_u16(acc, b, 25);
+        acc = vaddq_u16(acc, vdupq_n_u16(128));
+        vst1_u8(y + i, vadd_u8(vshrn_n_u16(acc, 8), vdup_n_u8(16)));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask5 = _mm_set1_epi16(0x1f);
+    const __m128i mask6 = _mm_set1_epi16(0x3f);
+    for (; i + 8 <= w; i += 8) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i r = _mm_srli_epi16(px, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(px, 5), mask6);
+        __m128i b = _mm_and_si128(px, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        // at most 56228, so the sum wraps nowhere as unsigned
+        __m128i acc = _mm_mullo_epi16(r, _mm_set1_epi16(66));
+        acc = _mm_add_epi16(acc, _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+        acc = _mm_add_epi16(acc, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+        acc = _mm_add_epi16(acc, _mm_set1_epi16(128));
+        acc = _mm_add_epi16(_mm_srli_epi16(acc, 8), _mm_set1_epi16(16));
+        _mm_storel_epi64((__m128i*)(y + i),
+                         _mm_packus_epi16(acc, _mm_setzero_si128()));
+    }
+#endif
+    for (; i < w; i++) {
+        int r, g, b;
+        _unpack565(p[i], &r, &g, &b);
+        y[i] = RGB_TO_Y(r, g, b);
+    }
+}
+
+// chroma of each 2x2 block, from its average color. a quarter of the
+// pixels, so it stays in C
+static void _rgb565ToUV(const uint8_t* src0, const uint8_t* src1,
+                        uint8_t* u, uint8_t* v, int w)
+{
+    const uint16_t* p0 = (const uint16_t*)src0;
+    const uint16_t* p1 = (const uint16_t*)src1;
+
+    for (int i = 0; i + 1 < w; i += 2) {
+        int r = 0, g = 0, b = 0;
+        const uint16_t px[4] = { p0[i], p0[i + 1], p1[i], p1[i + 1] };
+        for (int k = 0; k < 4; k++) {
+            int pr, pg, pb;
+            _unpack565(px[k], &pr, &pg, &pb);
+            r += pr;
+            g += pg;
+            b += pb;
+        }
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+        u[i / 2] = RGB_TO_U(r, g, b);
+        v[i / 2] = RGB_TO_V(r, g, b);
+    }
+}
+
+// 2:1 in both directions. each output is the rounded average of a 2x2
+// block of a and b, the two lines it covers
+static void _halveLines(const uint8_t* a, const uint8_t* b, uint8_t* dst,
+                        int n)
+{
+    int i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint16x8_t s0 = vpaddlq_u8(vld1q_u8(a + i * 2));
+        uint16x8_t s1 = vpaddlq_u8(vld1q_u8(a + i * 2 + 16));
+        s0 = vpadalq_u8(s0, vld1q_u8(b + i * 2));
+        s1 = vpadalq_u8(s1, vld1q_u8(b + i * 2 + 16));
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(s0, 2),
+                                      vrshrn_n_u16(s1, 2)));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    const __m128i two = _mm_set1_epi16(2);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(a + i * 2));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(a + i * 2 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(b + i * 2));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(b + i * 2 + 16));
+        __m128i s0 = _mm_add_epi16(
+            _mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+            _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+        __m128i s1 = _mm_add_epi16(
+            _mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+            _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+        s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+        s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(s0, s1));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (a[i * 2] + a[i * 2 + 1] + b[i * 2] + b[i * 2 + 1] + 2) >> 2;
+}
+
+// ======================================================================
+// NV12T, the tiled layout of FIMC. Each plane is cut into tiles of 64
+// bytes by 32 lines, 2048 bytes each. Along each pair of tile rows, tiles
+// go in groups of 2x2 in a Z, every other group flipped to start from the
+// lower row. A last odd tile row goes plainly left to right. Planes are
+// 128 bytes wide and 8KB aligned.
+
+#define TILE_W                  (64)
+#define TILE_H                  (32)
+#define TILE_SIZE               (TILE_W * TILE_H)
+
+#define ALIGN(x, a)             (((x) + (a) - 1) & ~((a) - 1))
+
+static inline size_t _tileIndex(int x, int y, int xTiles, int yTiles)
+{
+    size_t i = (y & ~1) * xTiles + x;
+
+    if (y & 1)
+        i += (x & ~3) + 2;
+    else if ((yTiles & 1) == 0 || y != yTiles - 1)
+        i += (x + 2) & ~3;
+
+    return i;
+}
+
+// Line y of a tiled plane of yTiles tile rows, n bytes of it, as (tile
+// start, length) runs. The fused kernels work on the runs in place, so
+// nothing is copied twice.
+template <class OP>
+static inline void _forTileLine(const uint8_t* plane, int stride, int yTiles,
+                                int y, int n, OP& op)
+{
+    int xTiles = stride / TILE_W;
+    const uint8_t* row = plane + (y % TILE_H) * TILE_W;
+
+    for (int x = 0, off = 0; off < n; x++, off += TILE_W) {
+        const uint8_t* tile = row + _tileIndex(x, y / TILE_H, xTiles,
+                                               yTiles) * TILE_SIZE;
+        op(tile, off, n - off < TILE_W ? n - off : TILE_W);
+    }
+}
+
+struct _tileCopy {
+    uint8_t* dst;
+    void operator()(const uint8_t* src, int off, int len) {
+        memcpy(dst + off, src, len);
+    }
+};
+
+struct _tileSwap {
+    uint8_t* dst;
+    void operator()(const uint8_t* src, int off, int len) {
+        _swapPairs(src, dst + off, len / 2);
+    }
+};
+
+struct _tileSplit {
+    uint8_t* a;
+    uint8_t* b;
+    void operator()(const uint8_t* src, int off, int len) {
+        _splitPairs(src, a + off / 2, b + off / 2, len / 2);
+    }
+};
+
+// ======================================================================
+// Frames
+
+// Offsets of the planes of a frame in one buffer, from its start.
+static int _layoutPlanes(unsigned int fmt, int w, int h, int stride,
+                         size_t* offsets, int* strides)
+{
+    memset(offsets, 0, sizeof(size_t) * 3);
+    memset(strides, 0, sizeof(int) * 3);
+
+    switch (fmt) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_RGB565:
+        strides[0] = stride ? stride : w * 2;
+        return 0;
+
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV21:
+        strides[0] = stride ? stride : w;
+        strides[1] = strides[0];
+        offsets[1] = strides[0] * h;
+        return 0;
+
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YUV422P: {
+        int chromaH = fmt == V4L2_PIX_FMT_YUV422P ? h : h / 2;
+        strides[0] = stride ? stride : w;
+        strides[1] = strides[0] / 2;
+        strides[2] = strides[1];
+        offsets[1] = strides[0] * h;
+        offsets[2] = offsets[1] + strides[1] * chromaH;
+        return 0;
+    }
+
+    case V4L2_PIX_FMT_NV12T:
+        // tiles fix the layout, whatever the driver says the stride is
+        strides[0] = ALIGN(w, 2 * TILE_W);
+        strides[1] = strides[0];
+        offsets[1] = ALIGN(strides[0] * ALIGN(h, TILE_H), 8192);
+        return 0;
+
+    default:
+        LOGE("%s: unsupported format, %.4s", __func__, (const char*)&fmt);
+        return -1;
+    }
+}
+
+int ccLayout(unsigned int fmt, uint8_t* base, int w, int h, int stride,
+             struct ccImage* img)
+{
+    size_t offsets[3];
+    if (_layoutPlanes(fmt, w, h, stride, offsets, img->strides) < 0) {
+        memset(img, 0, sizeof(*img));
+        return -1;
+    }
+
+    for (int p = 0; p < 3; p++)
+        img->planes[p] = img->strides[p] ? base + offsets[p] : NULL;
+
+    return 0;
+}
+
+// Lines [y0, y1) of one source format into one destination format. The
+// formats are template arguments so that each instance is left with only
+// the kernels of its pair, and no format tests per line.
+template <unsigned int SRC, unsigned int DST>
+static void _convertRows(const struct ccImage* src, struct ccImage* dst,
+                         int w, int h, int y0, int y1)
+{
+    // chroma made up line by line, for destinations it can't go to as is
+    uint8_t tmpU[CC_MAX_WIDTH / 2];
+    uint8_t tmpV[CC_MAX_WIDTH / 2];
+    const bool semi = DST != V4L2_PIX_FMT_YVU420;
+    int cw = w / 2;
+
+    for (int y = y0; y < y1; y += 2) {
+        const uint8_t* s0 = src->planes[0] + src->strides[0] * y;
+        const uint8_t* s1 = s0 + src->strides[0];
+        uint8_t* d0 = dst->planes[0] + dst->strides[0] * y;
+        uint8_t* d1 = d0 + dst->strides[0];
+
+        // luma
+        if (SRC == V4L2_PIX_FMT_YUYV) {
+            _yuyvToY(s0, d0, w);
+            _yuyvToY(s1, d1, w);
+        } else if (SRC == V4L2_PIX_FMT_RGB565) {
+            _rgb565ToY(s0, d0, w);
+            _rgb565ToY(s1, d1, w);
+        } else {
+            memcpy(d0, s0, w);
+            memcpy(d1, s1, w);
+        }
+
+        // chroma. YVU420 keeps Cr in plane 1, NV12 and NV21 have pairs
+        int cy = y / 2;
+        uint8_t* dVU = dst->planes[1] + dst->strides[1] * cy;
+        uint8_t* dU = semi ? tmpU : dst->planes[2] + dst->strides[2] * cy;
+        uint8_t* dV = semi ? tmpV : dVU;
+        const uint8_t* sU = dU;
+        const uint8_t* sV = dV;
+
+        switch (SRC) {
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_NV21: {
+            const uint8_t* sUV = src->planes[1] + src->strides[1] * cy;
+            if (semi && SRC == DST)
+                memcpy(dVU, sUV, cw * 2);
+            else if (semi)
+                _swapPairs(sUV, dVU, cw);
+            else if (SRC == V4L2_PIX_FMT_NV21)
+                _splitPairs(sUV, dV, dU, cw);
+            else
+                _splitPairs(sUV, dU, dV, cw);
+            continue;
+        }
+
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_YVU420: {
+            int pU = SRC == V4L2_PIX_FMT_YUV420 ? 1 : 2;
+            sU = src->planes[pU] + src->strides[pU] * cy;
+            sV = src->planes[3 - pU] + src->strides[3 - pU] * cy;
+            if (!semi) {
+                memcpy(dU, sU, cw);
+                memcpy(dV, sV, cw);
+                continue;
+            }
+            break;
+        }
+
+        case V4L2_PIX_FMT_YUV422P: {
+            const uint8_t* u0 = src->planes[1] + src->strides[1] * y;
+            const uint8_t* v0 = src->planes[2] + src->strides[2] * y;
+            _avgLines(u0, u0 + src->strides[1], dU, cw);
+            _avgLines(v0, v0 + src->strides[2], dV, cw);
+            break;
+        }
+
+        case V4L2_PIX_FMT_YUYV:
+            _yuyvToUV(s0, s1, dU, dV, w);
+            break;
+
+        case V4L2_PIX_FMT_RGB565:
+            _rgb565ToUV(s0, s1, dU, dV, w);
+            break;
+        }
+
+        if (DST == V4L2_PIX_FMT_NV21)
+            _mergePairs(sV, sU, dVU, cw);
+        else if (DST == V4L2_PIX_FMT_NV12)
+            _mergePairs(sU, sV, dVU, cw);
+    }
+}
+
+// NV12T into linear lines [y0, y1), in one pass over the tiles. With
+// SHIFT 1 every 2x2 block is averaged down to one pixel, lines counting
+// in the smaller frame; w and h are those of the tiled one.
+template <unsigned int DST, int SHIFT>
+static void _detileRows(const struct ccImage* src, struct ccImage* dst,
+                        int w, int h, int y0, int y1)
+{
+    // whole lines of the tiled frame, only when halving
+    uint8_t line0[SHIFT ? CC_MAX_WIDTH : 1];
+    uint8_t line1[SHIFT ? CC_MAX_WIDTH : 1];
+    uint8_t tmpU[SHIFT ? CC_MAX_WIDTH / 2 : 1];
+    uint8_t tmpV[SHIFT ? CC_MAX_WIDTH / 2 : 1];
+    int yTiles = ALIGN(h, TILE_H) / TILE_H;
+    int cyTiles = ALIGN(h / 2, TILE_H) / TILE_H;
+    int dw = w >> SHIFT;
+
+    for (int y = y0; y < y1; y++) {
+        uint8_t* d = dst->planes[0] + dst->strides[0] * y;
+        if (SHIFT) {
+            struct _tileCopy c0 = { line0 }, c1 = { line1 };
+            _forTileLine(src->planes[0], src->strides[0], yTiles, y * 2, w,
+                         c0);
+            _forTileLine(src->planes[0], src->strides[0], yTiles, y * 2 + 1,
+                         w, c1);
+            _halveLines(line0, line1, d, dw);
+        } else {
+            struct _tileCopy c = { d };
+            _forTileLine(src->planes[0], src->strides[0], yTiles, y, w, c);
+        }
+
+        if (y & 1)
+            continue;
+
+        // chroma, in the same pass as the first of its two lines
+        int cy = y / 2;
+        int dcw = dw / 2;
+        uint8_t* dVU = dst->planes[1] + dst->strides[1] * cy;
+        uint8_t* dU = DST == V4L2_PIX_FMT_YVU420 ?
+                      dst->planes[2] + dst->strides[2] * cy : tmpU;
+        uint8_t* dV = DST == V4L2_PIX_FMT_YVU420 ? dVU : tmpV;
+
+        if (SHIFT) {
+            // halved apart, as averaging pairs would mix Cb with Cr
+            struct _tileSplit s0 = { line0, line0 + CC_MAX_WIDTH / 2 };
+            struct _tileSplit s1 = { line1, line1 + CC_MAX_WIDTH / 2 };
+            _forTileLine(src->planes[1], src->strides[1], cyTiles, cy * 2,
+                         w, s0);
+            _forTileLine(src->planes[1], src->strides[1], cyTiles,
+                         cy * 2 + 1, w, s1);
+            _halveLines(s0.a, s1.a, dU, dcw);
+            _halveLines(s0.b, s1.b, dV, dcw);
+
+            if (DST == V4L2_PIX_FMT_NV21)
+                _mergePairs(dV, dU, dVU, dcw);
+            else if (DST == V4L2_PIX_FMT_NV12)
+                _mergePairs(dU, dV, dVU, dcw);
+        } else if (DST == V4L2_PIX_FMT_NV12) {
+            struct _tileCopy c = { dVU };
+            _forTileLine(src->planes[1], src->strides[1], cyTiles, cy, w, c);
+        } else if (DST == V4L2_PIX_FMT_NV21) {
+            struct _tileSwap c = { dVU };
+            _forTileLine(src->planes[1], src->strides[1], cyTiles, cy, w, c);
+        } else {
+            struct _tileSplit c = { dU, dV };
+            _forTileLine(src->planes[1], src->strides[1], cyTiles, cy, w, c);
+        }
+    }
+}
+
+#define CC_KERNEL(S, D)                                             \
+    { V4L2_PIX_FMT_##S, V4L2_PIX_FMT_##D, 0,                        \
+      _convertRows<V4L2_PIX_FMT_##S, V4L2_PIX_FMT_##D> }
+#define CC_DETILE(D, SHIFT)                                         \
+    { V4L2_PIX_FMT_NV12T, V4L2_PIX_FMT_##D, SHIFT,                  \
+      _detileRows<V4L2_PIX_FMT_##D, SHIFT> }
+
+// every source against every destination, and NV12T halved as well
+static const struct {
+    unsigned int src;
+    unsigned int dst;
+    int shift;
+    ccRowsFunc rows;
+} _kernels[] = {
+    CC_KERNEL(NV21, YVU420),
+    CC_KERNEL(NV12, YVU420),
+    CC_KERNEL(YUYV, YVU420),
+    CC_KERNEL(YUV420, YVU420),
+    CC_KERNEL(YVU420, YVU420),
+    CC_KERNEL(YUV422P, YVU420),
+    CC_KERNEL(RGB565, YVU420),
+    CC_DETILE(YVU420, 0),
+    CC_DETILE(YVU420, 1),
+    CC_KERNEL(NV21, NV21),
+    CC_KERNEL(NV12, NV21),
+    CC_KERNEL(YUYV, NV21),
+    CC_KERNEL(YUV420, NV21),
+    CC_KERNEL(YVU420, NV21),
+    CC_KERNEL(YUV422P, NV21),
+    CC_KERNEL(RGB565, NV21),
+    CC_DETILE(NV21, 0),
+    CC_DETILE(NV21, 1),
+    CC_KERNEL(NV21, NV12),
+    CC_KERNEL(NV12, NV12),
+    CC_KERNEL(YUYV, NV12),
+    CC_KERNEL(YUV420, NV12),
+    CC_KERNEL(YVU420, NV12),
+    CC_KERNEL(YUV422P, NV12),
+    CC_KERNEL(RGB565, NV12),
+    CC_DETILE(NV12, 0),
+    CC_DETILE(NV12, 1),
+};
+
+#undef CC_KERNEL
+#undef CC_DETILE
+
+static ccRowsFunc _findKernel(unsigned int srcFmt, unsigned int dstFmt,
+                              int shift)
+{
+    for (size_t i = 0; i < sizeof(_kernels) / sizeof(_kernels[0]); i++) {
+        if (_kernels[i].src == srcFmt && _kernels[i].dst == dstFmt &&
+            _kernels[i].shift == shift)
+            return _kernels[i].rows;
+    }
+
+    return NULL;
+}
+
+bool ccCanConvert(unsigned int srcFmt, unsigned int dstFmt)
+{
+    return _findKernel(srcFmt, dstFmt, 0) != NULL;
+}
+
+int ccConvert(unsigned int srcFmt, const struct ccImage* src,
+              unsigned int dstFmt, struct ccImage* dst,
+              int w, int h, int y0, int y1)
+{
+    ccRowsFunc rows = _findKernel(srcFmt, dstFmt, 0);
+    if (rows == NULL || w > CC_MAX_WIDTH || (y0 & 1) || (y1 & 1)) {
+        LOGE("%s: can't convert %.4s to %.4s, %d wide, lines %d-%d",
+             __func__, (const char*)&srcFmt, (const char*)&dstFmt,
+             w, y0, y1);
+        return -1;
+    }
+
+    rows(src, dst, w, h, y0, y1);
+
+    return 0;
+}
+
+// ======================================================================
+// ccConverter
+
+ccConverter::ccConverter()
+{
+    reset();
+}
+
+void ccConverter::reset(void)
+{
+    _rows = NULL;
+    _srcFmt = 0;
+    _dstFmt = 0;
+    _w = 0;
+    _h = 0;
+    _shift = 0;
+    memset(_offsets, 0, sizeof(_offsets));
+    memset(_strides, 0, sizeof(_strides));
+}
+
+int ccConverter::init(unsigned int srcFmt, unsigned int dstFmt,
+                      int w, int h, int stride, int shift)
+{
+    reset();
+
+    int align = 2 << shift;
+    if (w > CC_MAX_WIDTH || w % align || h % align) {
+        LOGE("%s: can't convert %dx%d frames", __func__, w, h);
+        return -1;
+    }
+
+    if (_layoutPlanes(srcFmt, w, h, stride, _offsets, _strides) < 0)
+        return -1;
+
+    _srcFmt = srcFmt;
+    _dstFmt = dstFmt;
+    _w = w;
+    _h = h;
+    _shift = shift;
+
+    // frames still lay out without a kernel, for callers that only copy
+    _rows = _findKernel(srcFmt, dstFmt, shift);
+    LOGW_IF(_rows == NULL, "%s: no conversion from %.4s to %.4s, 1/%d",
+            __func__, (const char*)&srcFmt, (const char*)&dstFmt, 1 << shift);
+
+    return _rows ? 0 : -1;
+}
+
+void ccConverter::layout(uint8_t* base, struct ccImage* img) const
+{
+    for (int p = 0; p < 3; p++) {
+        img->planes[p] = _strides[p] ? base + _offsets[p] : NULL;
+        img->strides[p] = _strides[p];
+    }
+}
+
+};
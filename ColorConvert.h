@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_COLOR_CONVERT_H__
+#define __ANDROID_COLOR_CONVERT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// widest frame ccConvert() takes
+#define CC_MAX_WIDTH            (4096)
+
+namespace android {
+
+// Planes of a frame and the bytes per line of each, in the plane order
+// of its V4L2 format. YVU420 (YV12) is Y, Cr, Cb; NV12 and NV21 have the
+// chroma pairs in the second plane.
+struct ccImage {
+    uint8_t* planes[3];
+    int strides[3];
+};
+
+// Planes of a frame that lies in one buffer, as single-planar V4L2
+// formats do. stride is the bytes per luma line, 0 for packed lines.
+int ccLayout(unsigned int fmt, uint8_t* base, int w, int h, int stride,
+             struct ccImage* img);
+
+bool ccCanConvert(unsigned int srcFmt, unsigned int dstFmt);
+
+// Convert lines [y0, y1) of a w x h frame. Sources are NV21, NV12,
+// NV12T, YUYV, YUV420, YVU420, YUV422P and RGB565; destinations YVU420,
+// NV21 and NV12. y0 and y1 are even, so each band owns whole chroma lines.
+int ccConvert(unsigned int srcFmt, const struct ccImage* src,
+              unsigned int dstFmt, struct ccImage* dst,
+              int w, int h, int y0, int y1);
+
+// lines [y0, y1) of the converted frame, from a w x h one, between two
+// set formats
+typedef void (*ccRowsFunc)(const struct ccImage* src, struct ccImage* dst,
+                           int w, int h, int y0, int y1);
+
+// One conversion, resolved once for a stream of frames of the same
+// format, size and stride. Converting a frame then takes no lookups and
+// no tests on the format.
+class ccConverter {
+public:
+    ccConverter();
+
+    // -1 if there's no kernel for the pair. Frames still lay out as long
+    // as the source format is known, see layout(). Frames come out
+    // shrunk by 1 << shift each way; only NV12T sources can be halved.
+    int init(unsigned int srcFmt, unsigned int dstFmt, int w, int h,
+             int stride, int shift = 0);
+    void reset(void);
+
+    bool canConvert(void) const { return _rows != NULL; }
+    unsigned int srcFmt(void) const { return _srcFmt; }
+    unsigned int dstFmt(void) const { return _dstFmt; }
+    // of the converted frames
+    int width(void) const { return _w >> _shift; }
+    int height(void) const { return _h >> _shift; }
+
+    // planes of a source frame that lies in one buffer
+    void layout(uint8_t* base, struct ccImage* img) const;
+
+    // lines [y0, y1) of the converted frame
+    void operator()(const struct ccImage* src, struct ccImage* dst,
+                    int y0, int y1) const {
+        _rows(src, dst, _w, _h, y0, y1);
+    }
+    void operator()(const struct ccImage* src, struct ccImage* dst) const {
+        _rows(src, dst, _w, _h, 0, _h >> _shift);
+    }
+
+private:
+    ccRowsFunc _rows;
+    unsigned int _srcFmt;
+    unsigned int _dstFmt;
+    int _w;
+    int _h;
+    int _shift;
+    size_t _offsets[3];
+    int _strides[3];
+};
+
+};
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host benchmark of the preview color conversion kernels. For every pair
+// ccConverter has a kernel for, at a few preview sizes, it reports the
+// time per frame and the bytes read and written per second. NV12T is
+// also run halved, sizes then being those of the tiled frames.
+//
+//   colorconvert_bench [frames]
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConvertBench"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/videodev2.h>
+#include "videodev2_samsung.h"
+
+#include "ColorConvert.h"
+
+using namespace android;
+
+#define BENCH_FRAMES_DEF        (200)
+
+static const unsigned int _srcFmts[] = {
+    V4L2_PIX_FMT_NV21,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_NV12T,
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_YVU420,
+    V4L2_PIX_FMT_YUV422P,
+    V4L2_PIX_FMT_RGB565,
+};
+
+static const unsigned int _dstFmts[] = {
+    V4L2_PIX_FMT_YVU420,
+    V4L2_PIX_FMT_NV21,
+    V4L2_PIX_FMT_NV12,
+};
+
+static const struct {
+    const char* name;
+    int w;
+    int h;
+} _sizes[] = {
+    { "QVGA", 320, 240 },
+    { "VGA", 640, 480 },
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+};
+
+// bytes a kernel touches in a frame of the format, padding left out
+static size_t _frameBytes(unsigned int fmt, int w, int h)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_RGB565:
+    case V4L2_PIX_FMT_YUV422P:
+        return (size_t)w * h * 2;
+    default:
+        return (size_t)w * h * 3 / 2;
+    }
+}
+
+static int64_t _nowNs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : BENCH_FRAMES_DEF;
+    if (frames <= 0)
+        frames = BENCH_FRAMES_DEF;
+
+    // room for the largest frame of any format, tiled ones included
+    size_t bufSize = (size_t)CC_MAX_WIDTH * 1088 * 4;
+    uint8_t* src = (uint8_t*)malloc(bufSize);
+    uint8_t* dst = (uint8_t*)malloc(bufSize);
+    if (src == NULL || dst == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < bufSize; i++)
+        src[i] = (uint8_t)(i * 2654435761u >> 24);
+    memset(dst, 0, bufSize);
+
+    printf("%-6s %-6s %-8s %10s %8s\n", "src", "dst", "size", "us/frame",
+           "GB/s");
+
+    for (size_t s = 0; s < sizeof(_srcFmts) / sizeof(_srcFmts[0]); s++) {
+        for (size_t d = 0; d < sizeof(_dstFmts) / sizeof(_dstFmts[0]); d++) {
+            unsigned int srcFmt = _srcFmts[s];
+            unsigned int dstFmt = _dstFmts[d];
+            if (!ccCanConvert(srcFmt, dstFmt))
+                continue;
+
+            int maxShift = srcFmt == V4L2_PIX_FMT_NV12T ? 1 : 0;
+            for (int shift = 0; shift <= maxShift; shift++)
+            for (size_t z = 0; z < sizeof(_sizes) / sizeof(_sizes[0]); z++) {
+                int w = _sizes[z].w;
+                int h = _sizes[z].h;
+
+                ccConverter conv;
+                if (conv.init(srcFmt, dstFmt, w, h, 0, shift) < 0)
+                    continue;
+
+                struct ccImage in, out;
+                conv.layout(src, &in);
+                ccLayout(dstFmt, dst, conv.width(), conv.height(), 0, &out);
+
+                // once to fault the buffers in
+                conv(&in, &out);
+
+                int64_t start = _nowNs();
+                for (int i = 0; i < frames; i++)
+                    conv(&in, &out);
+                int64_t ns = _nowNs() - start;
+
+                double bytes = (double)(_frameBytes(srcFmt, w, h) +
+                                        _frameBytes(dstFmt, conv.width(),
+                                                    conv.height())) * frames;
+                char name[16];
+                snprintf(name, sizeof(name), "%s%s", _sizes[z].name,
+                         shift ? "/2" : "");
+                printf("%-6.4s %-6.4s %-8s %10.1f %8.2f\n",
+                       (const char*)&srcFmt, (const char*)&dstFmt,
+                       name, ns / 1000.0 / frames,
+                       ns ? bytes / ns : 0.0);
+            }
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ConvertPool"
+#include <utils/Log.h>
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/properties.h>
+
+#include "ConvertPool.h"
+
+namespace android {
+
+ConvertPool::ConvertPool() :
+    _workerCnt(0),
+    _exit(false),
+    _conv(NULL),
+    _src(NULL),
+    _dst(NULL),
+    _bandLines(0),
+    _nextBand(0),
+    _pending(0),
+    _bands(1),
+    _maxBands(1),
+    _pixels(0),
+    _frames(0),
+    _frameTotal(0),
+    _bandTotal(0),
+    _lastBands(0),
+    _lastFrameAvg(0),
+    _hold(0),
+    _frameCnt(0),
+    _frameAvg(0),
+    _bandAvg(0),
+    _changes(0)
+{
+    memset(_bandTime, 0, sizeof(_bandTime));
+}
+
+ConvertPool::~ConvertPool()
+{
+    stop();
+}
+
+int ConvertPool::start(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get(CONVERT_THREADS_PROP, value, "");
+
+    int n = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (value[0] != '\0')
+        n = atoi(value);
+    if (n < 0)
+        n = 0;
+    if (n > MAX_CONVERT_THREADS)
+        n = MAX_CONVERT_THREADS;
+
+    _exit = false;
+    for (_workerCnt = 0; _workerCnt < (unsigned int)n; _workerCnt++) {
+        sp<WorkerThread> worker = new WorkerThread(this);
+        if (worker->run("CameraConvert", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+            LOGW("%s: only %u of %d workers", __func__, _workerCnt, n);
+            break;
+        }
+        _workers[_workerCnt] = worker;
+    }
+
+    _maxBands = _workerCnt + 1;
+    _bands = 1;
+    _pixels = 0;
+    LOGV("%s: %u workers", __func__, _workerCnt);
+
+    return 0;
+}
+
+void ConvertPool::stop(void)
+{
+    _lock.lock();
+    _exit = true;
+    _work.broadcast();
+    _lock.unlock();
+
+    for (unsigned int i = 0; i < _workerCnt; i++) {
+        _workers[i]->requestExitAndWait();
+        _workers[i].clear();
+    }
+    _workerCnt = 0;
+    _maxBands = 1;
+}
+
+bool ConvertPool::_workerLoop(void)
+{
+    Mutex::Autolock lock(_lock);
+
+    while (!_exit && (_conv == NULL || _nextBand >= _bands))
+        _work.wait(_lock);
+
+    if (_exit)
+        return false;
+
+    unsigned int band = _nextBand++;
+    _lock.unlock();
+    _runBand(band);
+    _lock.lock();
+
+    if (--_pending == 0)
+        _done.signal();
+
+    return true;
+}
+
+void ConvertPool::_runBand(unsigned int band)
+{
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    int y0 = band * _bandLines;
+    int y1 = y0 + _bandLines;
+    if (y1 > _conv->height())
+        y1 = _conv->height();
+    if (y0 < y1)
+        (*_conv)(_src, _dst, y0, y1);
+
+    _bandTime[band] = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+}
+
+void ConvertPool::convert(const ccConverter& conv, const struct ccImage* src,
+                          struct ccImage* dst)
+{
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    Mutex::Autolock lock(_lock);
+
+    // a new frame size starts over from the size alone
+    int pixels = conv.width() * conv.height();
+    if (pixels != _pixels) {
+        _pixels = pixels;
+        _bands = (pixels + CONVERT_BAND_PIXELS - 1) / CONVERT_BAND_PIXELS;
+        if (_bands < 1)
+            _bands = 1;
+        if (_bands > _maxBands)
+            _bands = _maxBands;
+        _frames = 0;
+        _frameTotal = 0;
+        _bandTotal = 0;
+        _lastBands = 0;
+        _hold = 0;
+        _frameCnt = 0;
+        _changes = 0;
+    }
+
+    _conv = &conv;
+    _src = src;
+    _dst = dst;
+    _bandLines = ((conv.height() + _bands - 1) / _bands + 1) & ~1;
+    _nextBand = 0;
+    _pending = _bands;
+    if (_bands > 1)
+        _work.broadcast();
+
+    // take bands here too, then wait for the rest
+    while (_nextBand < _bands) {
+        unsigned int band = _nextBand++;
+        _lock.unlock();
+        _runBand(band);
+        _lock.lock();
+        _pending--;
+    }
+    while (_pending)
+        _done.wait(_lock);
+    _conv = NULL;
+
+    for (unsigned int i = 0; i < _bands; i++)
+        _bandTotal += _bandTime[i];
+    _frameTotal += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if (++_frames >= CONVERT_ADAPT_FRAMES)
+        _adapt();
+}
+
+// Fewer bands when they're so short that handing them out costs as much
+// as converting, more when they're long, and back when a change made
+// frames slower.
+void ConvertPool::_adapt(void)
+{
+    nsecs_t frameAvg = _frameTotal / _frames;
+    nsecs_t bandAvg = _bandTotal / (_frames * _bands);
+    unsigned int bands = _bands;
+
+    if (_lastBands && _lastBands != _bands &&
+        frameAvg > _lastFrameAvg + _lastFrameAvg / 20) {
+        bands = _lastBands;
+        _hold = CONVERT_HOLD_WINDOWS;
+    } else if (_hold) {
+        _hold--;
+    } else if (bandAvg < us2ns(CONVERT_BAND_MIN_US) && _bands > 1) {
+        bands = _bands - 1;
+    } else if (bandAvg > us2ns(CONVERT_BAND_MAX_US) && _bands < _maxBands) {
+        bands = _bands + 1;
+    }
+
+    LOGV_IF(bands != _bands, "%s: %u -> %u bands, frame %lldus, band %lldus",
+            __func__, _bands, bands, ns2us(frameAvg), ns2us(bandAvg));
+
+    _frameCnt += _frames;
+    _frameAvg = frameAvg;
+    _bandAvg = bandAvg;
+    if (bands != _bands)
+        _changes++;
+
+    _lastBands = _bands;
+    _lastFrameAvg = frameAvg;
+    _bands = bands;
+    _frames = 0;
+    _frameTotal = 0;
+    _bandTotal = 0;
+}
+
+void ConvertPool::dump(String8& result) const
+{
+    result.appendFormat("  convert: %u bands of %u, %u workers, "
+                        "frame %lldus, band %lldus, %u changes in %u frames\n",
+                        _bands, _maxBands, _workerCnt, ns2us(_frameAvg),
+                        ns2us(_bandAvg), _changes, _frameCnt);
+}
+
+};
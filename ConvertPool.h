@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_CONVERT_POOL_H__
+#define __ANDROID_CONVERT_POOL_H__
+
+#include <utils/threads.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include "ColorConvert.h"
+
+// worker threads besides the caller. unset picks one less than the CPUs
+// online, "0" converts on the caller alone
+#define CONVERT_THREADS_PROP    "camera.convert.threads"
+#define MAX_CONVERT_THREADS     (3)
+#define MAX_CONVERT_BANDS       (MAX_CONVERT_THREADS + 1)
+
+// a band per this many pixels to start with
+#define CONVERT_BAND_PIXELS     (256 * 1024)
+// frames between band count changes
+#define CONVERT_ADAPT_FRAMES    (30)
+// bands quicker than this are mostly handoff, slower ones worth splitting
+#define CONVERT_BAND_MIN_US     (500)
+#define CONVERT_BAND_MAX_US     (4000)
+// windows a band count that made frames slower is left alone for
+#define CONVERT_HOLD_WINDOWS    (10)
+
+namespace android {
+
+// Converts frames in bands of lines on a few persistent threads, the
+// caller's included, and returns once every band is done. The number of
+// bands starts from the frame size and then follows the measured time of
+// each band. One caller at a time.
+class ConvertPool {
+public:
+    ConvertPool();
+    ~ConvertPool();
+
+    int start(void);
+    void stop(void);
+
+    void convert(const ccConverter& conv, const struct ccImage* src,
+                 struct ccImage* dst);
+    void dump(String8& result) const;
+
+private:
+    class WorkerThread : public Thread {
+        ConvertPool* _pool;
+    public:
+        WorkerThread(ConvertPool* pool):Thread(false), _pool(pool) { }
+        virtual bool threadLoop() { return _pool->_workerLoop(); }
+    };
+    sp<WorkerThread> _workers[MAX_CONVERT_THREADS];
+    unsigned int _workerCnt;
+    bool _workerLoop(void);
+
+    // the frame being converted. bands are taken in order under _lock
+    mutable Mutex _lock;
+    Condition _work;
+    Condition _done;
+    bool _exit;
+    const ccConverter* _conv;
+    const struct ccImage* _src;
+    struct ccImage* _dst;
+    int _bandLines;
+    unsigned int _nextBand;
+    unsigned int _pending;
+    nsecs_t _bandTime[MAX_CONVERT_BANDS];
+
+    void _runBand(unsigned int band);
+
+    // band count, and what it is adapted from
+    unsigned int _bands;
+    unsigned int _maxBands;
+    int _pixels;
+    unsigned int _frames;
+    nsecs_t _frameTotal;
+    nsecs_t _bandTotal;
+    unsigned int _lastBands;
+    nsecs_t _lastFrameAvg;
+    unsigned int _hold;
+    void _adapt(void);
+
+    // since the last frame size change
+    unsigned int _frameCnt;
+    nsecs_t _frameAvg;
+    nsecs_t _bandAvg;
+    unsigned int _changes;
+};
+
+};
+#endif
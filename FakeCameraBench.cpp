@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host driver of SecCamera against the synthetic sensor. It runs preview,
+// takes pictures the way CameraHardware does when preview has to stop,
+// and prints preview throughput, shot-to-shot time and how long the
+// preview state changes take.
+//
+//   fakecamera_bench [preview frames] [shots]
+//
+// The camera.fake.* properties tune the sensor, see SecV4L2FakeDevice.h.
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FakeCameraBench"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/Timers.h>
+
+#include "SecCamera.h"
+#include "CameraFactory.h"
+
+// the parameter names SecV4L2Adapter matches against live in
+// libcamera_client, which has no host build
+#include "CameraParameters.cpp"
+
+#define BENCH_PREVIEW_FRAMES_DEF    (300)
+#define BENCH_SHOTS_DEF             (5)
+#define BENCH_WAIT_TIMEOUT          (1000)
+
+#define BENCH_PREVIEW_W             (640)
+#define BENCH_PREVIEW_H             (480)
+#define BENCH_PICTURE_W             (2048)
+#define BENCH_PICTURE_H             (1536)
+
+namespace android {
+
+// pictures stay raw; nothing is compressed on the host
+EncoderInterface* get_encoder(void)
+{
+    return NULL;
+}
+
+TaggerInterface* get_tagger(void)
+{
+    return NULL;
+}
+
+};
+
+using namespace android;
+
+struct timing {
+    nsecs_t total;
+    nsecs_t min;
+    nsecs_t max;
+    unsigned int count;
+};
+
+static void _addTiming(struct timing* t, nsecs_t ns)
+{
+    if (t->count == 0 || ns < t->min)
+        t->min = ns;
+    if (ns > t->max)
+        t->max = ns;
+    t->total += ns;
+    t->count++;
+}
+
+static void _printTiming(const char* name, const struct timing* t)
+{
+    if (t->count == 0) {
+        printf("  %-22s -\n", name);
+        return;
+    }
+
+    printf("  %-22s avg %7.2fms  min %7.2fms  max %7.2fms  (%u)\n", name,
+           t->total / 1e6 / t->count, t->min / 1e6, t->max / 1e6, t->count);
+}
+
+// Takes one preview frame and hands it straight back. -1 on timeout.
+static int _cyclePreviewFrame(SecCamera* camera, SecV4L2FrameInfo* info)
+{
+    for (;;) {
+        int ready = camera->waitStreams(BENCH_WAIT_TIMEOUT);
+        if (ready <= 0)
+            return -1;
+        if (!(ready & CAMERA_STREAM_PREVIEW))
+            continue;
+
+        int index;
+        if (camera->dqPreviewBuffer(&index, NULL, NULL, info) < 0 ||
+            index < 0)
+            continue;
+
+        camera->qPreviewBuffer(index);
+        return 0;
+    }
+}
+
+// Starts preview and waits for its first frame.
+static int _startPreview(SecCamera* camera, struct timing* start,
+                         struct timing* firstFrame)
+{
+    SecV4L2FrameInfo info;
+    nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (camera->startPreview() < 0) {
+        LOGE("%s: preview didn't start", __func__);
+        return -1;
+    }
+    nsecs_t t1 = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (_cyclePreviewFrame(camera, &info) < 0) {
+        LOGE("%s: no first preview frame", __func__);
+        return -1;
+    }
+    nsecs_t t2 = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    _addTiming(start, t1 - t0);
+    _addTiming(firstFrame, t2 - t0);
+    return 0;
+}
+
+// A picture as CameraHardware takes it when preview has to stop for it,
+// up to the raw frame.
+static int _takePicture(SecCamera* camera, uint8_t** raw, size_t* rawSize,
+                        struct timing* stop, struct timing* capture)
+{
+    nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+    camera->stopPreview();
+    nsecs_t t1 = systemTime(SYSTEM_TIME_MONOTONIC);
+    _addTiming(stop, t1 - t0);
+
+    size_t size = 0;
+    if (camera->startSnapshot(&size) != 0) {
+        LOGE("%s: snapshot didn't start", __func__);
+        return -1;
+    }
+
+    if (*rawSize != size) {
+        free(*raw);
+        *raw = (uint8_t*)malloc(size);
+        *rawSize = *raw ? size : 0;
+        if (*raw == NULL) {
+            camera->endSnapshot();
+            return -1;
+        }
+    }
+
+    camera->setSnapshotBuffer(*raw, *rawSize);
+    int ret = camera->getSnapshot();
+    if (ret == 0)
+        ret = camera->getRawSnapshot(*raw, *rawSize);
+    camera->endSnapshot();
+    _addTiming(capture, systemTime(SYSTEM_TIME_MONOTONIC) - t1);
+
+    LOGE_IF(ret != 0, "%s: no picture", __func__);
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    int previewFrames = argc > 1 ? atoi(argv[1]) : BENCH_PREVIEW_FRAMES_DEF;
+    int shots = argc > 2 ? atoi(argv[2]) : BENCH_SHOTS_DEF;
+    if (previewFrames <= 0)
+        previewFrames = BENCH_PREVIEW_FRAMES_DEF;
+    if (shots < 0)
+        shots = BENCH_SHOTS_DEF;
+
+    SecCamera* camera = new SecCamera(0);
+    if (camera->getFd() <= 0) {
+        fprintf(stderr, "no camera\n");
+        return 1;
+    }
+
+    camera->setPreviewFormat(BENCH_PREVIEW_W, BENCH_PREVIEW_H,
+                             CameraParameters::PIXEL_FORMAT_YUV420SP);
+    camera->setSnapshotFormat(BENCH_PICTURE_W, BENCH_PICTURE_H, "yuv422i");
+
+    struct timing start = { 0, 0, 0, 0 };
+    struct timing firstFrame = { 0, 0, 0, 0 };
+    struct timing stop = { 0, 0, 0, 0 };
+    struct timing capture = { 0, 0, 0, 0 };
+    struct timing shot = { 0, 0, 0, 0 };
+    struct timing frame = { 0, 0, 0, 0 };
+
+    if (_startPreview(camera, &start, &firstFrame) < 0)
+        return 1;
+
+    // preview throughput, with gaps in the sequence counted as drops
+    SecV4L2FrameInfo info;
+    unsigned int dropped = 0;
+    unsigned int lastSeq = 0;
+    nsecs_t first = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t last = first;
+    for (int i = 0; i < previewFrames; i++) {
+        if (_cyclePreviewFrame(camera, &info) < 0) {
+            LOGE("preview stalled after %d frames", i);
+            previewFrames = i;
+            break;
+        }
+
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (i > 0) {
+            _addTiming(&frame, now - last);
+            if (info.sequence > lastSeq + 1)
+                dropped += info.sequence - lastSeq - 1;
+        }
+        lastSeq = info.sequence;
+        last = now;
+    }
+
+    // shot to shot: from the stop of preview to its first frame after
+    uint8_t* raw = NULL;
+    size_t rawSize = 0;
+    for (int i = 0; i < shots; i++) {
+        nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (_takePicture(camera, &raw, &rawSize, &stop, &capture) < 0 ||
+            _startPreview(camera, &start, &firstFrame) < 0)
+            break;
+        _addTiming(&shot, systemTime(SYSTEM_TIME_MONOTONIC) - t0);
+    }
+
+    camera->stopPreview();
+
+    printf("preview %dx%d, pictures %dx%d\n", BENCH_PREVIEW_W,
+           BENCH_PREVIEW_H, BENCH_PICTURE_W, BENCH_PICTURE_H);
+    printf("preview: %d frames, %.1f fps, %u dropped\n", previewFrames,
+           last > first ? (previewFrames - 1) * 1e9 / (last - first) : 0.0,
+           dropped);
+    _printTiming("frame interval", &frame);
+    printf("pictures:\n");
+    _printTiming("shot to shot", &shot);
+    _printTiming("capture", &capture);
+    printf("state changes:\n");
+    _printTiming("startPreview", &start);
+    _printTiming("to first frame", &firstFrame);
+    _printTiming("stopPreview", &stop);
+
+    String8 dump;
+    camera->dump(dump);
+    printf("%s", dump.string());
+
+    free(raw);
+    delete camera;
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FrameQueue"
+#include <utils/Log.h>
+
+#include <cutils/atomic.h>
+#include <cutils/atomic-inline.h>
+#include <utils/Debug.h>
+
+#include "FrameQueue.h"
+
+namespace android {
+
+FrameQueue::FrameQueue() :
+    _head(0),
+    _tail(0),
+    _pending(0),
+    _waiting(0),
+    _abort(false),
+    _pushes(0),
+    _full(0),
+    _maxDepth(0),
+    _depthTotal(0)
+{
+    // ring positions are masked, not taken modulo
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(
+        (FRAME_QUEUE_SIZE & (FRAME_QUEUE_SIZE - 1)) == 0);
+}
+
+// false, and nothing queued, if the consumer is FRAME_QUEUE_SIZE behind
+bool FrameQueue::push(int index, const SecV4L2FrameInfo* info)
+{
+    int32_t tail = _tail;
+    uint32_t depth = tail - android_atomic_acquire_load(&_head);
+    if (depth >= FRAME_QUEUE_SIZE) {
+        android_atomic_inc(&_full);
+        return false;
+    }
+
+    struct frame* f = &_frames[(uint32_t)tail & (FRAME_QUEUE_SIZE - 1)];
+    f->index = index;
+    f->info = *info;
+
+    android_atomic_inc(&_pending);
+    android_atomic_release_store(tail + 1, &_tail);
+
+    android_atomic_inc(&_pushes);
+    android_atomic_add(depth + 1, &_depthTotal);
+    int32_t max;
+    while ((max = android_atomic_acquire_load(&_maxDepth)) < (int32_t)depth + 1)
+        if (android_atomic_cmpxchg(max, depth + 1, &_maxDepth) == 0)
+            break;
+
+    // Either the consumer sees the new tail before it sleeps, or this
+    // sees it waiting. It holds the lock from setting _waiting until it
+    // sleeps, so the signal can't come in between.
+    ANDROID_MEMBAR_FULL();
+    if (android_atomic_acquire_load(&_waiting)) {
+        Mutex::Autolock lock(_lock);
+        _pushed.signal();
+    }
+
+    return true;
+}
+
+bool FrameQueue::_pop(struct frame* f)
+{
+    int32_t head = _head;
+    if (head == android_atomic_acquire_load(&_tail))
+        return false;
+
+    *f = _frames[(uint32_t)head & (FRAME_QUEUE_SIZE - 1)];
+    android_atomic_release_store(head + 1, &_head);
+
+    return true;
+}
+
+// The next frame, waiting for one if there is none. -1 after abort().
+int FrameQueue::wait(struct frame* f)
+{
+    while (!_pop(f)) {
+        Mutex::Autolock lock(_lock);
+        if (_abort)
+            return -1;
+
+        android_atomic_release_store(1, &_waiting);
+        ANDROID_MEMBAR_FULL();
+        if (depth() == 0)
+            _pushed.wait(_lock);
+        android_atomic_release_store(0, &_waiting);
+    }
+
+    return 0;
+}
+
+void FrameQueue::done(void)
+{
+    if (android_atomic_dec(&_pending) == 1) {
+        Mutex::Autolock lock(_lock);
+        _idle.broadcast();
+    }
+}
+
+// Wait until the consumer is done with every frame pushed so far.
+void FrameQueue::drain(void)
+{
+    Mutex::Autolock lock(_lock);
+    while (!_abort && android_atomic_acquire_load(&_pending) > 0)
+        _idle.wait(_lock);
+}
+
+// Wake both sides for good, to stop the consumer.
+void FrameQueue::abort(void)
+{
+    Mutex::Autolock lock(_lock);
+    _abort = true;
+    _pushed.broadcast();
+    _idle.broadcast();
+}
+
+unsigned int FrameQueue::depth(void) const
+{
+    return android_atomic_acquire_load(&_tail) -
+           android_atomic_acquire_load(&_head);
+}
+
+void FrameQueue::dump(String8& result, const char* name) const
+{
+    result.appendFormat("  %s queue: depth=%u max=%u avg=%.1f frames=%u "
+                        "full=%u\n",
+                        name, depth(), (uint32_t)_maxDepth,
+                        _pushes ? (double)(uint32_t)_depthTotal /
+                                  (uint32_t)_pushes : 0.0,
+                        (uint32_t)_pushes, (uint32_t)_full);
+}
+
+};
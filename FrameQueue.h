@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_FRAME_QUEUE_H__
+#define __ANDROID_FRAME_QUEUE_H__
+
+#include <stdint.h>
+#include <utils/threads.h>
+#include <utils/String8.h>
+#include "SecV4L2Adapter.h"
+
+// entries of the ring. a power of two, and no less than the most
+// buffers a stream can have
+#define FRAME_QUEUE_SIZE        (MAX_CAM_BUFFERS)
+
+namespace android {
+
+// Dequeued frames handed from one thread to one other. push() and pop()
+// never block: the ring's tail is only written by the producer and its
+// head by the consumer. The consumer sleeps in wait() only while the
+// ring is empty, and push() only takes the lock to wake it then. Each
+// frame is reported done() once its buffer is back with the camera,
+// which drain() waits for.
+class FrameQueue {
+public:
+    struct frame {
+        int index;
+        SecV4L2FrameInfo info;
+    };
+
+    FrameQueue();
+
+    // producer
+    bool push(int index, const SecV4L2FrameInfo* info);
+    void drain(void);
+
+    // consumer
+    int wait(struct frame* f);
+    void done(void);
+
+    void abort(void);
+    unsigned int depth(void) const;
+    void dump(String8& result, const char* name) const;
+
+private:
+    struct frame _frames[FRAME_QUEUE_SIZE];
+    volatile int32_t _head;
+    volatile int32_t _tail;
+    // pushed and not done() yet
+    volatile int32_t _pending;
+    // the consumer is about to sleep, or sleeping, on _pushed
+    volatile int32_t _waiting;
+
+    bool _abort;
+    Mutex _lock;
+    Condition _pushed;
+    Condition _idle;
+
+    // depth seen by each push, and pushes that found the ring full
+    volatile int32_t _pushes;
+    volatile int32_t _full;
+    volatile int32_t _maxDepth;
+    volatile int32_t _depthTotal;
+
+    bool _pop(struct frame* f);
+};
+
+};
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Log entry points of liblog for the host tools, printing to stderr.
+// Only what the LOG macros of cutils/log.h reach is here.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+static const char _prioChars[] = "??VDIWEFS";
+
+extern "C" int __android_log_vprint(int prio, const char* tag,
+                                    const char* fmt, va_list ap)
+{
+    char c = prio >= 0 && prio < (int)sizeof(_prioChars) - 1 ?
+             _prioChars[prio] : '?';
+    int ret = fprintf(stderr, "%c/%s: ", c, tag ? tag : "");
+    ret += vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    return ret + 1;
+}
+
+extern "C" int __android_log_print(int prio, const char* tag,
+                                   const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = __android_log_vprint(prio, tag, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+extern "C" int __android_log_write(int prio, const char* tag,
+                                   const char* text)
+{
+    return __android_log_print(prio, tag, "%s", text);
+}
+
+extern "C" void __android_log_assert(const char* cond, const char* tag,
+                                     const char* fmt, ...)
+{
+    if (fmt) {
+        va_list ap;
+        va_start(ap, fmt);
+        __android_log_vprint(7, tag, fmt, ap);
+        va_end(ap);
+    } else {
+        __android_log_print(7, tag, "assertion failed: %s", cond);
+    }
+    abort();
+}
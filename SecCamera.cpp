@@ -20,7 +20,9 @@
 #include "CameraLog.h"
 
 #include <stdlib.h>
+#include <errno.h>
 #include <math.h>
+#include <cutils/properties.h>
 
 #include "SecCamera.h"
 #include "CameraFactory.h"
@@ -36,20 +38,58 @@ SecCamera::SecCamera(int ch) :
     _previewWidth(0),
     _previewHeight(0),
     _previewPixfmt(-1),
+    _previewDrvPixfmt(-1),
+    _tiledPreview(false),
+    _halvedPreview(false),
+    _previewShift(0),
     _previewFrameSize(0),
     _snapshotWidth(0),
     _snapshotHeight(0),
     _snapshotPixfmt(-1),
     _isPreviewOn(false),
     _isRecordOn(false),
+    _directPreview(false),
+    _previewUserBufCnt(0),
+    _isPreviewUserBufs(false),
+    _previewHeld(0),
+    _recordPolicy(SecV4L2Adapter::DELIVER_FIFO),
+    _recordMaxAge(0),
+    _frameRate(30),
+    _bufBudget(CAMERA_BUF_BUDGET_DEF * 1024),
+    _encoderHoldMs(CAMERA_ENC_HOLD_DEF),
+    _zslEnabled(false),
+    _isZslOn(false),
+    _zslWidth(0),
+    _zslHeight(0),
+    _zslFrameCnt(CAMERA_ZSL_FRAMES_DEF),
+    _zslRingCnt(0),
+    _zslRingMax(0),
+    _zslCaptureIdx(-1),
+    _zslPreview(NULL),
+    _zslPreviewSize(0),
+    _zslSlotSize(0),
+    _zslCaptures(0),
+    _zslLagTotal(0),
+    _burstCount(1),
+    _isBurstOn(false),
+    _dropInterval(CAMERA_DROP_INTERVAL_DEF),
+    _dropAlarm(CAMERA_DROP_ALARM_DEF),
+    _dropAlarms(0),
+    _dropCb(NULL),
+    _dropUser(NULL),
     _v4l2Cam(NULL),
     _v4l2Rec(NULL),
+    _v4l2Cap(NULL),
+    _snapshotNode(NULL),
+    _sideCapture(false),
+    _reactor(NULL),
     _encoder(NULL),
     _tagger(NULL)
 {
     LOGI("%s()", __func__);
 
     _v4l2Cam = new SecV4L2Adapter(CAMERA_DEV_NAME, ch);
+    _reactor = new SecV4L2Reactor();
     _encoder = get_encoder();
     _tagger = get_tagger();
 
@@ -59,7 +99,13 @@ SecCamera::SecCamera(int ch) :
         return;
     }
 
+    // preview only cares about the newest frame
+    _v4l2Cam->setDeliveryPolicy(SecV4L2Adapter::DELIVER_LATEST);
+    memset(_previewUserBufs, 0, sizeof(_previewUserBufs));
+
     _initParms();
+    _loadBufConfig();
+    _openSideCapture();
 
     _isInited = true;
 }
@@ -97,6 +143,15 @@ void SecCamera::_release(void)
 
     if (_v4l2Rec)
         delete _v4l2Rec;
+
+    if (_v4l2Cap)
+        delete _v4l2Cap;
+
+    if (_reactor)
+        delete _reactor;
+
+    free(_zslPreview);
+    _zslPreview = NULL;
 }
 
 int SecCamera::getFd(void)
@@ -104,11 +159,103 @@ int SecCamera::getFd(void)
     return _v4l2Cam->getFd();
 }
 
+void SecCamera::dump(String8& result)
+{
+    result.appendFormat("  buffers: preview=%u record=%u budget=%uKB "
+                        "encoder hold=%ums fps=%d\n",
+                        _v4l2Cam->getBufCnt(),
+                        _v4l2Rec ? _v4l2Rec->getBufCnt() : 0,
+                        _bufBudget / 1024, _encoderHoldMs, _frameRate);
+    result.appendFormat("  zsl: %s ring=%u/%u captures=%u avg lag=%lldus\n",
+                        _isZslOn ? "on" : "off", _zslRingCnt, _zslRingMax,
+                        _zslCaptures,
+                        _zslCaptures ? ns2us(_zslLagTotal / _zslCaptures) : 0);
+    _reactor->dump(result);
+    _v4l2Cam->dump(result, "preview");
+    if (_v4l2Rec)
+        _v4l2Rec->dump(result, "record");
+    if (_v4l2Cap)
+        _v4l2Cap->dump(result, "capture");
+}
+
+// ======================================================================
+// Buffer counts
+
+void SecCamera::_loadBufConfig(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(CAMERA_BUF_BUDGET_PROP, value, "");
+    if (atoi(value) > 0)
+        _bufBudget = atoi(value) * 1024;
+
+    property_get(CAMERA_ENC_HOLD_PROP, value, "");
+    if (value[0] != '\0' && atoi(value) >= 0)
+        _encoderHoldMs = atoi(value);
+
+    property_get(CAMERA_ZSL_FRAMES_PROP, value, "");
+    if (atoi(value) > 0)
+        _zslFrameCnt = atoi(value);
+
+    property_get(CAMERA_DIRECT_PREVIEW_PROP, value, "0");
+    _directPreview = atoi(value) == 1;
+
+    property_get(CAMERA_TILED_PREVIEW_PROP, value, "0");
+    _tiledPreview = atoi(value) == 1 || atoi(value) == 2;
+    _halvedPreview = atoi(value) == 2;
+
+    property_get(CAMERA_SIDE_CAPTURE_PROP, value, "0");
+    _sideCapture = atoi(value) == 1;
+
+    property_get(CAMERA_DROP_INTERVAL_PROP, value, "");
+    if (atoi(value) > 0)
+        _dropInterval = atoi(value);
+
+    property_get(CAMERA_DROP_ALARM_PROP, value, "");
+    if (value[0] != '\0' && atoi(value) >= 0)
+        _dropAlarm = atoi(value);
+
+    LOGV("%s: budget = %uKB, encoder hold = %ums", __func__,
+         _bufBudget / 1024, _encoderHoldMs);
+}
+
+// Buffers for one stream: one the driver fills, one ready to be taken,
+// one the HAL works on, and one per frame its consumer keeps. Faster
+// rates get one more since there is less time to return each. Shrinks
+// toward MIN_CAM_BUFFERS while the set doesn't fit the budget.
+unsigned int SecCamera::_getBufCnt(int w, int h, int pixfmt,
+                                   unsigned int held, size_t budget)
+{
+    size_t frameSize = w * h * 3 / 2;
+    if (pixfmt == V4L2_PIX_FMT_YUYV || pixfmt == V4L2_PIX_FMT_UYVY ||
+        pixfmt == V4L2_PIX_FMT_NV16 || pixfmt == V4L2_PIX_FMT_NV61 ||
+        pixfmt == V4L2_PIX_FMT_YUV422P || pixfmt == V4L2_PIX_FMT_RGB565)
+        frameSize = w * h * 2;
+
+    unsigned int n = MIN_CAM_BUFFERS + held;
+    if (_frameRate > 30)
+        n++;
+    if (n > MAX_CAM_BUFFERS)
+        n = MAX_CAM_BUFFERS;
+
+    while (n > MIN_CAM_BUFFERS && n * frameSize > budget)
+        n--;
+
+    LOGW_IF(n * frameSize > budget,
+            "%s: %u buffers of %dx%d take %uKB, over the %uKB left",
+            __func__, n, w, h, n * frameSize / 1024, budget / 1024);
+    LOGV("%s: %dx%d, %u held -> %u buffers", __func__, w, h, held, n);
+
+    return n;
+}
+
 // ======================================================================
 // Preview
 
 int SecCamera::startPreview(void)
 {
+    Mutex::Autolock streamLock(_streamLock);
+
     // aleady started
     if (_isPreviewOn == true) {
         LOGE("ERR(%s):Preview was already started\n", __func__);
@@ -116,13 +263,86 @@ int SecCamera::startPreview(void)
     }
 
     int ret = 0;
-    ret = _v4l2Cam->setupBufs(_previewWidth, _previewHeight, _previewPixfmt,
-                              MAX_CAM_BUFFERS, 0);
+    _isZslOn = _zslEnabled && _canZsl();
+
+    // tiles suit the DMA of FIMC better. frames are de-tiled by whoever
+    // needs them linear, which buffers of the caller can't wait for
+    _previewDrvPixfmt = _previewPixfmt;
+    if (_tiledPreview && !_isZslOn && !_previewUserBufCnt &&
+        (_previewPixfmt == V4L2_PIX_FMT_NV21 ||
+         _previewPixfmt == V4L2_PIX_FMT_NV12) &&
+        _hasTiledPreview())
+        _previewDrvPixfmt = V4L2_PIX_FMT_NV12T;
+
+    _previewShift = 0;
+    if (_halvedPreview && _previewDrvPixfmt == V4L2_PIX_FMT_NV12T &&
+        _hasTiledSize(_previewWidth * 2, _previewHeight * 2))
+        _previewShift = 1;
+    int captureW = _previewWidth << _previewShift;
+    int captureH = _previewHeight << _previewShift;
+    if (_isZslOn) {
+        // the sensor runs in capture mode, at picture size, for the whole
+        // preview. frames kept back for capture count as held
+        unsigned int n = _getBufCnt(_snapshotWidth, _snapshotHeight,
+                                    _snapshotPixfmt, _zslFrameCnt, _bufBudget);
+        ret = _v4l2Cam->setupBufs(_snapshotWidth, _snapshotHeight,
+                                  _snapshotPixfmt, n, 1);
+    } else if (_previewUserBufCnt) {
+        // one capture buffer per buffer of the caller
+        ret = _v4l2Cam->setupBufs(_previewWidth, _previewHeight,
+                                  _previewDrvPixfmt, _previewUserBufCnt, 0,
+                                  V4L2_MEMORY_USERPTR);
+        _isPreviewUserBufs =
+            ret == (int)_previewUserBufCnt &&
+            _v4l2Cam->getMemory() == V4L2_MEMORY_USERPTR;
+        LOGW_IF(!_isPreviewUserBufs, "%s: driver won't take %u user buffers",
+                __func__, _previewUserBufCnt);
+    }
+
+    if (!_isZslOn && !_isPreviewUserBufs) {
+        // preview frames wait to be copied out before being requeued
+        unsigned int n = _getBufCnt(captureW, captureH, _previewDrvPixfmt,
+                                    _previewHeld, _bufBudget);
+        ret = _v4l2Cam->setupBufs(captureW, captureH, _previewDrvPixfmt,
+                                  n, 0);
+    }
     CHECK(ret > 0);
 
+    // share buffers by dma-buf if the driver can export them
+    _v4l2Cam->exportBufs();
+
+    // separate planes can't be reached through the camera fd as one
+    // frame, and zsl frames are scaled by the cpu. map them here and
+    // hand them out by getPreviewPlane()
+    if (_v4l2Cam->getPlaneCnt() > 1 || _isZslOn) {
+        for (int i = 0; i < ret; i++) {
+            int err = _v4l2Cam->mapBuf(i);
+            CHECK_EQ(err, 0);
+        }
+    }
+
+    if (_isZslOn) {
+        int err = _startZsl(ret);
+        CHECK_EQ(err, 0);
+    }
+
     /* start with all buffers in queue */
-    ret = _v4l2Cam->qAllBufs();
-    CHECK_EQ(ret, 0);
+    if (_isPreviewUserBufs) {
+        // only those the caller has handed in so far
+        for (unsigned int i = 0; i < _previewUserBufCnt; i++) {
+            struct userBuf* buf = &_previewUserBufs[i];
+            if (buf->start == NULL)
+                continue;
+
+            ret = _v4l2Cam->setUserBuf(i, buf->start, buf->size);
+            if (ret == 0)
+                ret = _v4l2Cam->qBuf(i);
+            CHECK_EQ(ret, 0);
+        }
+    } else {
+        ret = _v4l2Cam->qAllBufs();
+        CHECK_EQ(ret, 0);
+    }
 
     ret = _v4l2Cam->startStream(true);
     CHECK_EQ(ret, 0);
@@ -140,6 +360,9 @@ int SecCamera::startPreview(void)
     ret = _v4l2Cam->qBuf(index);
     CHECK_EQ(ret, 0);
 
+    ret = _reactor->addNode(_v4l2Cam, CAMERA_STREAM_PREVIEW);
+    CHECK_EQ(ret, 0);
+
     return 0;
 }
 
@@ -147,13 +370,23 @@ int SecCamera::stopPreview(void)
 {
     LOG_CAMERA_FUNC_ENTER;
 
+    Mutex::Autolock streamLock(_streamLock);
     if (_isPreviewOn == false)
         return 0;
 
+    _reactor->removeNode(_v4l2Cam);
+
     int ret = _v4l2Cam->startStream(false);
     CHECK(ret == 0);
 
     _v4l2Cam->closeBufs();
+
+    // a frame taken by a capture in flight is not requeued by
+    // endSnapshot() once preview is off
+    Mutex::Autolock lock(_zslLock);
+    _zslRingCnt = 0;
+    _isZslOn = false;
+    _isPreviewUserBufs = false;
     _isPreviewOn = false;
 
     return 0;
@@ -164,6 +397,7 @@ int SecCamera::stopPreview(void)
 //Recording
 int SecCamera::startRecord(void)
 {
+    Mutex::Autolock streamLock(_streamLock);
     int ret = 0;
     // aleady started
     if (_isRecordOn == true) {
@@ -177,13 +411,24 @@ int SecCamera::startRecord(void)
             LOGE("failed to open rec video ch");
             return -1;
         }
+        _v4l2Rec->setDeliveryPolicy(_recordPolicy, _recordMaxAge);
     }
 
+    // the encoder keeps frames for a while; cover that time at the
+    // current rate, within what preview left of the budget
+    unsigned int held = (_encoderHoldMs * _frameRate + 999) / 1000;
+    size_t used = _v4l2Cam->getBufCnt() * _v4l2Cam->frameSize();
+    size_t budget = used < _bufBudget ? _bufBudget - used : 0;
+    unsigned int n = _getBufCnt(_previewWidth, _previewHeight,
+                                V4L2_PIX_FMT_NV12, held, budget);
+
     ret = _v4l2Rec->setupBufs(_previewWidth, _previewHeight,
                               V4L2_PIX_FMT_NV12,
-                              MAX_CAM_BUFFERS, 0);
+                              n, 0);
     CHECK(ret > 0);
 
+    _v4l2Rec->exportBufs();
+
     /* start with all buffers in queue */
     ret = _v4l2Rec->qAllBufs();
     CHECK_EQ(ret, 0);
@@ -199,6 +444,9 @@ int SecCamera::startRecord(void)
     ret = _v4l2Rec->qBuf(index);
     CHECK(ret == 0);
 
+    ret = _reactor->addNode(_v4l2Rec, CAMERA_STREAM_RECORD);
+    CHECK_EQ(ret, 0);
+
     _isRecordOn = true;
     LOGI("Recording started!");
 
@@ -209,10 +457,12 @@ int SecCamera::stopRecord(void)
 {
     LOGV("%s :", __func__);
 
+    Mutex::Autolock streamLock(_streamLock);
     if (!_isRecordOn || _v4l2Rec == NULL) {
         return 0;
     }
 
+    _reactor->removeNode(_v4l2Rec);
 
     int ret = _v4l2Rec->startStream(false);
     CHECK(ret == 0);
@@ -231,22 +481,27 @@ int SecCamera::stopRecord(void)
     return 0;
 }
 
-int SecCamera::dqRecordBuffer(int* index, unsigned int* addrY, unsigned int* addrC)
+int SecCamera::dqRecordBuffer(int* index, unsigned int* addrY, unsigned int* addrC,
+                              SecV4L2FrameInfo* info)
 {
     if (!_isRecordOn || _v4l2Rec == NULL) {
         LOGW("Recording stoped! will ignore dqRecordBuffer!");
         return -1;
     }
 
-    _v4l2Rec->waitFrame();
-    //*index = _v4l2Rec->blk_dqbuf();
-    *index = _v4l2Rec->dqBuf();
+    // called once waitStreams() reported the record node ready
+    *index = _v4l2Rec->dqFrame(info);
     if (!(0 <= *index && *index < MAX_CAM_BUFFERS)) {
         LOGE("ERR(%s):wrong index = %d\n", __func__, *index);
         return -1;
     }
 
-    _v4l2Rec->getAddr(*index, addrY, addrC);
+    if ((addrY || addrC) && _v4l2Rec->getAddr(*index, addrY, addrC) < 0) {
+        if (addrY)
+            *addrY = 0;
+        if (addrC)
+            *addrC = 0;
+    }
 
     return 0;
 }
@@ -261,6 +516,32 @@ void SecCamera::qRecordBuffer(int index)
     int ret = _v4l2Rec->qBuf(index);
     //CHECK(ret == 0);
 }
+
+int SecCamera::getRecordBufCnt(void)
+{
+    if (_v4l2Rec == NULL)
+        return 0;
+
+    return _v4l2Rec->getBufCnt();
+}
+
+int SecCamera::getRecordBufFd(int index)
+{
+    if (_v4l2Rec == NULL)
+        return -1;
+
+    return _v4l2Rec->getBufFd(index);
+}
+
+// addresses are resolved once by startRecord() and stay fixed until
+// the record buffer set changes
+int SecCamera::getRecordAddr(int index, unsigned int* addrY, unsigned int* addrC)
+{
+    if (!_isRecordOn || _v4l2Rec == NULL)
+        return -1;
+
+    return _v4l2Rec->getAddr(index, addrY, addrC);
+}
 #endif
 
 int SecCamera::_getPhyAddr(int index, unsigned int* addrY, unsigned int* addrC)
@@ -270,23 +551,130 @@ int SecCamera::_getPhyAddr(int index, unsigned int* addrY, unsigned int* addrC)
     return 0;
 }
 
-int SecCamera::dqPreviewBuffer(int* index, unsigned int* addrY, unsigned int* addrC)
+int SecCamera::dqPreviewBuffer(int* index, unsigned int* addrY, unsigned int* addrC,
+                               SecV4L2FrameInfo* info)
 {
-    *index = _v4l2Cam->blk_dqbuf();
+    SecV4L2FrameInfo frame;
+    *index = _v4l2Cam->dqFrame(&frame);
     if (!(0 <= *index && *index < MAX_CAM_BUFFERS)) {
         LOGE("ERR(%s):wrong index = %d\n", __func__, *index);
         return -1;
     }
 
-    return _v4l2Cam->getAddr(*index, addrY, addrC);
+    if (info)
+        *info = frame;
+
+    if (_isZslOn)
+        return _pushZslFrame(*index, frame.timestamp);
+
+    // no addresses on multi-planar nodes. their planes go by fd
+    if ((addrY || addrC) && _v4l2Cam->getAddr(*index, addrY, addrC) < 0) {
+        if (addrY)
+            *addrY = 0;
+        if (addrC)
+            *addrC = 0;
+    }
+
+    return 0;
 }
 
 void SecCamera::qPreviewBuffer(int index)
 {
+    // zsl frames stay in the ring; the ring requeues them once their
+    // preview slot is back
+    if (_isZslOn) {
+        Mutex::Autolock lock(_zslLock);
+        if (0 <= index && index < MAX_CAM_BUFFERS && _zslShown[index]) {
+            _zslShown[index] = false;
+            if (_zslDone[index])
+                _releaseZslBuf(index);
+        }
+        return;
+    }
+
     int ret = _v4l2Cam->qBuf(index);
     LOGE_IF(ret, "Failed to queue preview buffer, %d to camera!", index);
 }
 
+int SecCamera::getPreviewBufFd(int index)
+{
+    // capture buffers of zsl aren't preview frames
+    if (_isZslOn)
+        return -1;
+
+    return _v4l2Cam->getBufFd(index);
+}
+
+int SecCamera::getPreviewPlaneCnt(void)
+{
+    if (_isZslOn)
+        return _previewPixfmt == V4L2_PIX_FMT_YUV420 ? 3 : 2;
+
+    return _v4l2Cam->getPlaneCnt();
+}
+
+// With zsl, planes of the frame scaled down for preview into the slot
+// of the index.
+int SecCamera::getPreviewPlane(int index, int plane, void** start, size_t* size)
+{
+    if (!_isZslOn)
+        return _v4l2Cam->mapPlaneInfo(index, plane, start, size);
+
+    if (plane < 0 || plane >= getPreviewPlaneCnt())
+        return -1;
+
+    size_t lumaSize = _previewWidth * _previewHeight;
+    size_t offset = 0;
+    size_t planeSize = lumaSize;
+    if (plane > 0) {
+        planeSize = getPreviewPlaneCnt() == 3 ? lumaSize / 4 : lumaSize / 2;
+        offset = lumaSize + (plane - 1) * planeSize;
+    }
+
+    if (start)
+        *start = _zslPreview + _zslSlotSize * index + offset;
+    if (size)
+        *size = planeSize;
+    return 0;
+}
+
+// Wait until any of the running streams has a frame. Returns the
+// CAMERA_STREAM_* bits of the ready streams, 0 on timeout.
+int SecCamera::waitStreams(int timeout)
+{
+    return _reactor->waitNodes(timeout);
+}
+
+// Called from another thread to stop waiting for frames now rather than
+// at the next timeout. Waits on a stream keep returning at once until the
+// stream is started again.
+void SecCamera::cancelWaits(void)
+{
+    _reactor->wake();
+    _v4l2Cam->cancelWait();
+    if (_v4l2Rec)
+        _v4l2Rec->cancelWait();
+    if (_v4l2Cap)
+        _v4l2Cap->cancelWait();
+}
+
+int SecCamera::setDeliveryPolicy(int streams, int policy, int maxAgeMs)
+{
+    int ret = 0;
+
+    if (streams & CAMERA_STREAM_PREVIEW)
+        ret |= _v4l2Cam->setDeliveryPolicy(policy, maxAgeMs);
+
+    if (streams & CAMERA_STREAM_RECORD) {
+        _recordPolicy = policy;
+        _recordMaxAge = maxAgeMs;
+        if (_v4l2Rec)
+            ret |= _v4l2Rec->setDeliveryPolicy(policy, maxAgeMs);
+    }
+
+    return ret;
+}
+
 void SecCamera::pausePreview()
 {
     _v4l2Cam->setCtrl(V4L2_CID_STREAM_PAUSE, 0);
@@ -298,6 +686,12 @@ int SecCamera::setPreviewFormat(int width, int height, const char* strPixfmt)
     _previewHeight = height;
     _previewPixfmt = _v4l2Cam->nPixfmt(strPixfmt);
 
+    // YV12 has Cr first. capture it that way where the driver can, so
+    // frames go straight into YV12 window buffers
+    if (_previewPixfmt == V4L2_PIX_FMT_YUV420 &&
+        _v4l2Cam->getCaps()->hasFmt(V4L2_PIX_FMT_YVU420))
+        _previewPixfmt = V4L2_PIX_FMT_YVU420;
+
     LOGI("previewFormat=%dx%d(%s), frameSize=%d",
          width, height, strPixfmt, _previewFrameSize);
 
@@ -305,8 +699,121 @@ int SecCamera::setPreviewFormat(int width, int height, const char* strPixfmt)
     return 0;
 }
 
+int SecCamera::getPreviewBufCnt(void)
+{
+    return _v4l2Cam->getBufCnt();
+}
+
+// Capture preview into n buffers of the caller rather than the driver's,
+// from the next startPreview(). Buffers are handed in by
+// setPreviewUserBuf(), before or while streaming; each one given before
+// startPreview() is queued then, later ones are queued by
+// qPreviewBuffer(). Check isPreviewUserBufs() after startPreview() for
+// whether the driver went along. 0 goes back to buffers of the driver.
+int SecCamera::setPreviewUserBufs(unsigned int n)
+{
+    if (n && (!_directPreview || _zslEnabled || n < MIN_CAM_BUFFERS ||
+              n > MAX_CAM_BUFFERS))
+        return -1;
+
+    if (_isPreviewOn) {
+        LOGE("%s: preview is running!", __func__);
+        return -1;
+    }
+
+    _previewUserBufCnt = n;
+    memset(_previewUserBufs, 0, sizeof(_previewUserBufs));
+
+    return 0;
+}
+
+int SecCamera::setPreviewUserBuf(int index, void* start, size_t size)
+{
+    if (index < 0 || (unsigned int)index >= _previewUserBufCnt) {
+        LOGE("%s: invalid index, %d!", __func__, index);
+        return -1;
+    }
+
+    _previewUserBufs[index].start = start;
+    _previewUserBufs[index].size = size;
+
+    if (_isPreviewUserBufs)
+        return _v4l2Cam->setUserBuf(index, start, size);
+
+    return 0;
+}
+
+bool SecCamera::isPreviewUserBufs(void)
+{
+    return _isPreviewUserBufs;
+}
+
+// takes effect on the next startPreview()
+void SecCamera::setPreviewHeld(unsigned int n)
+{
+    _previewHeld = n;
+}
+
+// the preview node lists NV12T, or its multi-planar variant
+bool SecCamera::_hasTiledPreview(void)
+{
+    SecV4L2Caps* caps = _v4l2Cam->getCaps();
+    if (caps->hasFmt(V4L2_PIX_FMT_NV12T))
+        return true;
+#ifdef V4L2_PIX_FMT_NV12MT
+    if (caps->hasFmt(V4L2_PIX_FMT_NV12MT))
+        return true;
+#endif
+    return false;
+}
+
+bool SecCamera::_hasTiledSize(int w, int h)
+{
+    SecV4L2Caps* caps = _v4l2Cam->getCaps();
+    if (caps->hasSize(V4L2_PIX_FMT_NV12T, w, h))
+        return true;
+#ifdef V4L2_PIX_FMT_NV12MT
+    if (caps->hasSize(V4L2_PIX_FMT_NV12MT, w, h))
+        return true;
+#endif
+    return false;
+}
+
+// Format of preview frames as captured. While preview runs this may be
+// NV12T, which only ColorConvert reads.
+int SecCamera::getPreviewPixfmt(void)
+{
+    return _isPreviewOn ? _previewDrvPixfmt : _previewPixfmt;
+}
+
+// Format of preview frames as callbacks hand them out
+int SecCamera::getPreviewCbPixfmt(void)
+{
+    return _previewPixfmt;
+}
+
+// Bytes per luma line of preview frames as the driver lays them out, 0
+// when lines are packed. Frames scaled down for zsl always are.
+int SecCamera::getPreviewStride(void)
+{
+    if (_isZslOn)
+        return 0;
+
+    return _v4l2Cam->getStride();
+}
+
+// Preview frames are captured 1 << shift the preview size each way, and
+// converted down to it, see CAMERA_TILED_PREVIEW_PROP
+int SecCamera::getPreviewShift(void)
+{
+    return _isPreviewOn ? _previewShift : 0;
+}
+
 unsigned int SecCamera::getPreviewFrameSize(void)
 {
+    if (_isZslOn)
+        return _zslPreviewSize;
+
     return _v4l2Cam->frameSize();
 }
 
@@ -318,40 +825,174 @@ void SecCamera::getPreviewFrameSize(int* width, int* height, int* frameSize)
     if (height)
         *height = _previewHeight;
     if (frameSize)
-        *frameSize =  _v4l2Cam->frameSize();
+        *frameSize = getPreviewFrameSize();
 
 }
 
+// ======================================================================
+// Dropped frames
+
+// cb, when set, is called from sampleDrops() as a stream goes over the
+// alarm level. 0 for the alarm level turns it off.
+void SecCamera::setDropCallback(camera_drop_callback cb, void* user)
+{
+    _dropCb = cb;
+    _dropUser = user;
+}
+
+int SecCamera::getDropInterval(void)
+{
+    return _dropInterval;
+}
+
+// Called every getDropInterval() msecs, off the frame path. Only
+// _streamLock is taken, so frames keep flowing while the driver's
+// counters are read; a stream being started or stopped waits.
+void SecCamera::sampleDrops(void)
+{
+    Mutex::Autolock streamLock(_streamLock);
+    if (!_isPreviewOn)
+        return;
+
+    _checkDrops(_v4l2Cam, "preview", CAMERA_STREAM_PREVIEW);
+    if (_isRecordOn && _v4l2Rec)
+        _checkDrops(_v4l2Rec, "record", CAMERA_STREAM_RECORD);
+}
+
+void SecCamera::_checkDrops(SecV4L2Adapter* node, const char* name,
+                            unsigned int stream)
+{
+    unsigned int permille = node->sampleDrops();
+    bool alarm = _dropAlarm && permille >= _dropAlarm;
+
+    if (alarm && !(_dropAlarms & stream)) {
+        LOGW("%s: %s lost %u.%u%% of frames lately", __func__, name,
+             permille / 10, permille % 10);
+        if (_dropCb)
+            _dropCb(_dropUser, name, permille);
+    }
+
+    if (alarm)
+        _dropAlarms |= stream;
+    else
+        _dropAlarms &= ~stream;
+}
+
 // ======================================================================
 // Snapshot
 int SecCamera::endSnapshot(void)
 {
-    return _v4l2Cam->closeBufs();
+    if (_isBurstOn) {
+        _v4l2Cam->startStream(false);
+        _isBurstOn = false;
+    }
+
+    if (_zslCaptureIdx >= 0) {
+        Mutex::Autolock lock(_zslLock);
+        if (_isPreviewOn)
+            _releaseZslBuf(_zslCaptureIdx);
+        _zslCaptureIdx = -1;
+        return 0;
+    }
+
+    return _snapshotNode->closeBufs();
+}
+
+int SecCamera::_startSnapshotStream(int memory, unsigned int n)
+{
+    int ret;
+    // the capture mode flag switches the sensor over. a side node only
+    // scales what the sensor is putting out for preview
+    int flag = _snapshotNode == _v4l2Cam ? 1 : 0;
+    ret = _snapshotNode->setupBufs(_snapshotWidth, _snapshotHeight,
+                                   _snapshotPixfmt, n, flag, memory);
+    CHECK(ret > 0);
+    if (ret <= 0)
+        return -1;
+
+    // userptr buffer is queued when the caller hands it in
+    if (_snapshotNode->getMemory() == V4L2_MEMORY_USERPTR)
+        return 0;
+
+    for (int i = 0; i < ret; i++) {
+        int err = _snapshotNode->mapBuf(i);
+        CHECK_EQ(err, 0);
+    }
+
+    _snapshotNode->qAllBufs();
+    _snapshotNode->startStream(true);
+
+    return 0;
 }
 
-int SecCamera::startSnapshot(size_t* captureSize)
+// shutterTime, in SYSTEM_TIME_MONOTONIC, picks the frame to capture with
+// zsl. See isZslCapture().
+int SecCamera::startSnapshot(size_t* captureSize, nsecs_t shutterTime)
 {
+    _snapshotNode = _v4l2Cam;
+
+    if (_isZslOn && _burstCount == 1) {
+        if (_pickZslFrame(shutterTime) == 0) {
+            _v4l2Cam->mapBufInfo(_zslCaptureIdx, NULL, captureSize);
+            return 0;
+        }
+        LOGW("%s: no zsl frame to take. capturing a new one", __func__);
+    }
+
+    if (isSideCapture()) {
+        // preview keeps streaming on its own node
+        _snapshotNode = _v4l2Cap;
+        int ret = _startSnapshotStream(V4L2_MEMORY_USERPTR);
+        if (ret == 0)
+            _snapshotNode->mapBufInfo(0, NULL, captureSize);
+        return ret;
+    }
+
     LOG_TIME_START(0);
     stopPreview();
     LOG_TIME_END(0);
 
-    int ret;
     LOG_TIME_START(1); // prepare
-    ret = _v4l2Cam->setupBufs(_snapshotWidth, _snapshotHeight, _snapshotPixfmt,
-                              1, 1);
-    CHECK_EQ(ret, 1);
-
-    ret = _v4l2Cam->mapBuf(0);
-    CHECK_EQ(ret, 0);
-
-    _v4l2Cam->qBuf(0);
-    _v4l2Cam->startStream(true);
+    if (_burstCount > 1) {
+        // enough buffers that the sensor fills one while others are
+        // being encoded. they are reused over the whole burst
+        unsigned int n = _getBufCnt(_snapshotWidth, _snapshotHeight,
+                                    _snapshotPixfmt, 0, _bufBudget);
+        if (n > (unsigned int)_burstCount)
+            n = _burstCount;
+        _startSnapshotStream(V4L2_MEMORY_MMAP, n);
+        _isBurstOn = true;
+    } else {
+        // try to capture straight into the client heap.
+        // see setSnapshotBuffer()
+        _startSnapshotStream(V4L2_MEMORY_USERPTR);
+    }
     LOG_TIME_END(1);
 
     LOG_CAMERA("%s: stopPreview(%lu), prepare(%lu) us",
                __func__, LOG_TIME(0), LOG_TIME(1));
 
-    _v4l2Cam->mapBufInfo(0, NULL, captureSize);
+    _snapshotNode->mapBufInfo(0, NULL, captureSize);
+
+    return 0;
+}
+
+int SecCamera::setSnapshotBuffer(uint8_t* buffer, size_t size)
+{
+    if (_snapshotNode->getMemory() != V4L2_MEMORY_USERPTR)
+        return 0;
+
+    int ret = _snapshotNode->setUserBuf(0, buffer, size);
+    if (ret == 0)
+        ret = _snapshotNode->qBuf(0);
+    if (ret == 0)
+        ret = _snapshotNode->startStream(true);
+
+    if (ret != 0) {
+        LOGW("%s: driver rejected user buffer. retrying with mmap", __func__);
+        _snapshotNode->closeBufs();
+        return _startSnapshotStream(V4L2_MEMORY_MMAP);
+    }
 
     return 0;
 }
@@ -362,29 +1003,85 @@ int SecCamera::getSnapshot(int xth)
     int index;
     int skipFirstNFrames = xth;
 
+    // taken from the ring already
+    if (_zslCaptureIdx >= 0)
+        return 0;
+
     LOG_TIME_START(0); // skip frames
     while (skipFirstNFrames) {
         LOGV("skipFrames %d", skipFirstNFrames);
-        _v4l2Cam->waitFrame();
-        index = _v4l2Cam->dqBuf();
-        _v4l2Cam->qBuf(index);
+        if (_snapshotNode->waitFrame())
+            break;
+        index = _snapshotNode->dqBuf();
+        if (index >= 0)
+            _snapshotNode->qBuf(index);
         skipFirstNFrames--;
     }
 
-    _v4l2Cam->waitFrame();
-    index = _v4l2Cam->dqBuf();
+    int ret = _snapshotNode->waitFrame();
+    index = ret ? ret : _snapshotNode->dqBuf();
     LOG_TIME_END(0);
 
     LOG_TIME_START(1);
-    _v4l2Cam->startStream(false);
+    _snapshotNode->startStream(false);
     LOG_TIME_END(1);
 
     LOG_CAMERA("%s: get frame after skip %d(%lu), stopStream(%lu)",
                __func__, xth, LOG_TIME(0), LOG_TIME(1));
 
+    if (index < 0) {
+        LOGE("%s: no frame captured (%d)", __func__, index);
+        return -1;
+    }
+
     return 0;
 }
 
+// Next frame of a burst, in capture order. Returns its buffer index,
+// which stays with the caller until releaseBurstFrame().
+int SecCamera::getBurstFrame(nsecs_t* timestamp)
+{
+    if (!_isBurstOn) {
+        LOGE("%s: no burst running!", __func__);
+        return -1;
+    }
+
+    SecV4L2FrameInfo info;
+    int index = _v4l2Cam->dqBuf(&info);
+    while (index == -EAGAIN) {
+        int err = _v4l2Cam->waitFrame();
+        if (err)
+            return err;
+
+        index = _v4l2Cam->dqBuf(&info);
+    }
+
+    if (index >= 0 && timestamp)
+        *timestamp = info.timestamp;
+
+    return index;
+}
+
+int SecCamera::getBurstFrameData(int index, uint8_t** data, size_t* size)
+{
+    void* start = NULL;
+    int ret = _v4l2Cam->mapBufInfo(index, &start, size);
+    if (ret)
+        return ret;
+
+    *data = (uint8_t*)start;
+    return 0;
+}
+
+void SecCamera::releaseBurstFrame(int index)
+{
+    if (!_isBurstOn)
+        return;
+
+    int ret = _v4l2Cam->qBuf(index);
+    LOGE_IF(ret, "Failed to queue burst buffer, %d to camera!", index);
+}
+
 int SecCamera::getRawSnapshot(uint8_t* buffer, size_t size)
 {
     if (buffer == NULL) {
@@ -394,7 +1091,12 @@ int SecCamera::getRawSnapshot(uint8_t* buffer, size_t size)
 
     void* captureStart;
     size_t captureSize;
-    _v4l2Cam->mapBufInfo(0, &captureStart, &captureSize);
+    _snapshotNode->mapBufInfo(_zslCaptureIdx >= 0 ? _zslCaptureIdx : 0,
+                         &captureStart, &captureSize);
+
+    // captured in place by setSnapshotBuffer()
+    if (captureStart == buffer)
+        return 0;
 
     if (size < captureSize) {
         LOGE("%s: buffer size, %d is too small! for snapshot size, %d",
@@ -408,6 +1110,19 @@ int SecCamera::getRawSnapshot(uint8_t* buffer, size_t size)
     return 0;
 }
 
+// Size and frame rate lists of a preview or picture format, as the driver
+// reported them. -1 if it didn't.
+int SecCamera::getSupportedSizes(const char* strPixfmt, String8& values)
+{
+    return _v4l2Cam->getCaps()->getSizes(_v4l2Cam->nPixfmt(strPixfmt), values);
+}
+
+int SecCamera::getSupportedFrameRates(const char* strPixfmt, String8& values)
+{
+    return _v4l2Cam->getCaps()->getFrameRates(_v4l2Cam->nPixfmt(strPixfmt),
+                                              values);
+}
+
 int SecCamera::setSnapshotFormat(int width, int height, const char* strPixfmt)
 {
     _snapshotWidth  = width;
@@ -430,6 +1145,259 @@ int SecCamera::setSnapshotFormat(int width, int height, const char* strPixfmt)
     return 0;
 }
 
+#ifdef DUAL_PORT_CAPTURE
+#define CAMERA_DEV_NAME3        "/dev/video1"
+#endif
+
+// Opened up front, so cancelWaits() can reach it from another thread.
+void SecCamera::_openSideCapture(void)
+{
+#ifdef DUAL_PORT_CAPTURE
+    if (!_sideCapture)
+        return;
+
+    _v4l2Cap = new SecV4L2Adapter(CAMERA_DEV_NAME3, _v4l2Cam->getChIdx());
+    if (_v4l2Cap->getFd() == 0)
+        LOGW("%s: no capture node. preview stops for pictures", __func__);
+#endif
+}
+
+// Whether a still can be captured on a node of its own while preview
+// keeps streaming. See CAMERA_SIDE_CAPTURE_PROP.
+bool SecCamera::isSideCapture(void)
+{
+    if (_v4l2Cap == NULL || _v4l2Cap->getFd() == 0)
+        return false;
+
+    if (!_isPreviewOn || _burstCount > 1)
+        return false;
+
+    // the sensor stays in preview mode. don't upscale its frames
+    if (_snapshotWidth > _previewWidth || _snapshotHeight > _previewHeight)
+        return false;
+
+    return _v4l2Cap->getCaps()->hasFmt(_snapshotPixfmt);
+}
+
+int SecCamera::setBurstCount(int count)
+{
+    if (count < 1 || count > CAMERA_MAX_BURST) {
+        LOGE("%s: invalid burst count, %d!", __func__, count);
+        return -1;
+    }
+
+    _burstCount = count;
+
+    return 0;
+}
+
+int SecCamera::getBurstCount(void)
+{
+    return _burstCount;
+}
+
+// Takes effect when preview starts next.
+int SecCamera::setZsl(bool on)
+{
+    LOGI("%s: %s", __func__, on ? "on" : "off");
+    _zslEnabled = on;
+
+    return 0;
+}
+
+// Whether startSnapshot() can take a frame preview has captured already.
+// Otherwise preview has to stop before it.
+bool SecCamera::isZslCapture(void)
+{
+    Mutex::Autolock lock(_zslLock);
+
+    return _isPreviewOn && _isZslOn && _zslRingCnt > 0 && _burstCount == 1 &&
+           _zslWidth == _snapshotWidth && _zslHeight == _snapshotHeight;
+}
+
+bool SecCamera::_canZsl(void)
+{
+    if (_snapshotPixfmt != V4L2_PIX_FMT_YUYV) {
+        LOGW("%s: zsl needs yuyv capture. disabled", __func__);
+        return false;
+    }
+
+    if (_previewPixfmt != V4L2_PIX_FMT_NV21 &&
+        _previewPixfmt != V4L2_PIX_FMT_NV12 &&
+        _previewPixfmt != V4L2_PIX_FMT_YUV420) {
+        LOGW("%s: preview format can't be scaled to. disabled", __func__);
+        return false;
+    }
+
+    if (_snapshotWidth < _previewWidth || _snapshotHeight < _previewHeight) {
+        LOGW("%s: picture is smaller than preview. disabled", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+// Leave two buffers with the driver to keep streaming; the rest are
+// kept back for capture.
+int SecCamera::_startZsl(unsigned int bufCnt)
+{
+    _zslSlotSize = _previewWidth * _previewHeight * 3 / 2;
+    size_t size = _zslSlotSize * bufCnt;
+    if (_zslPreviewSize != size) {
+        free(_zslPreview);
+        _zslPreview = (uint8_t*)malloc(size);
+        _zslPreviewSize = _zslPreview ? size : 0;
+        if (_zslPreview == NULL) {
+            LOGE("%s: no memory for preview frame!", __func__);
+            return -1;
+        }
+    }
+
+    Mutex::Autolock lock(_zslLock);
+    _zslWidth = _snapshotWidth;
+    _zslHeight = _snapshotHeight;
+    _zslRingCnt = 0;
+    _zslRingMax = bufCnt > 2 ? bufCnt - 2 : 1;
+    memset(_zslShown, 0, sizeof(_zslShown));
+    memset(_zslDone, 0, sizeof(_zslDone));
+
+    LOGI("%s: %dx%d, keeping %u of %u frames", __func__,
+         _zslWidth, _zslHeight, _zslRingMax, bufCnt);
+
+    return 0;
+}
+
+int SecCamera::_pushZslFrame(int index, nsecs_t timestamp)
+{
+    void* start = NULL;
+    _v4l2Cam->mapBufInfo(index, &start, NULL);
+    if (start == NULL) {
+        LOGE("%s: buffer-%d not mapped!", __func__, index);
+        _v4l2Cam->qBuf(index);
+        return -1;
+    }
+
+    // the slot is free: the buffer was only requeued once it came back
+    _scaleZslPreview((const uint8_t*)start,
+                     _zslPreview + _zslSlotSize * index);
+
+    Mutex::Autolock lock(_zslLock);
+    _zslShown[index] = true;
+    _zslDone[index] = false;
+    if (_zslRingCnt == _zslRingMax) {
+        _releaseZslBuf(_zslRing[0].index);
+        memmove(&_zslRing[0], &_zslRing[1],
+                sizeof(_zslRing[0]) * --_zslRingCnt);
+    }
+
+    _zslRing[_zslRingCnt].index = index;
+    _zslRing[_zslRingCnt].timestamp = timestamp;
+    _zslRingCnt++;
+
+    return 0;
+}
+
+// Take the frame captured closest to the shutter out of the ring. It
+// goes back to the driver at endSnapshot().
+int SecCamera::_pickZslFrame(nsecs_t shutterTime)
+{
+    Mutex::Autolock lock(_zslLock);
+
+    if (_zslRingCnt == 0 ||
+        _zslWidth != _snapshotWidth || _zslHeight != _snapshotHeight)
+        return -1;
+
+    unsigned int best = _zslRingCnt - 1;
+    nsecs_t bestLag = 0;
+    for (unsigned int i = 0; i < _zslRingCnt; i++) {
+        nsecs_t lag = _zslRing[i].timestamp - shutterTime;
+        if (lag < 0)
+            lag = -lag;
+
+        if (i == 0 || lag < bestLag) {
+            best = i;
+            bestLag = lag;
+        }
+    }
+
+    _zslCaptureIdx = _zslRing[best].index;
+    memmove(&_zslRing[best], &_zslRing[best + 1],
+            sizeof(_zslRing[0]) * (_zslRingCnt - best - 1));
+    _zslRingCnt--;
+
+    _zslCaptures++;
+    _zslLagTotal += bestLag;
+    LOGV("%s: buffer-%d, %lldus from shutter", __func__,
+         _zslCaptureIdx, ns2us(bestLag));
+
+    return 0;
+}
+
+// A buffer the ring and capture are done with goes back to the driver,
+// unless preview still shows its slot; then qPreviewBuffer() requeues it.
+// Called with _zslLock held.
+void SecCamera::_releaseZslBuf(int index)
+{
+    if (_zslShown[index]) {
+        _zslDone[index] = true;
+        return;
+    }
+
+    _zslDone[index] = false;
+    _v4l2Cam->qBuf(index);
+}
+
+// Nearest-neighbour downscale of a yuyv capture frame into dst in the
+// preview format. Chroma is taken from the even rows and columns.
+void SecCamera::_scaleZslPreview(const uint8_t* src, uint8_t* dst)
+{
+    int sw = _zslWidth;
+    int sh = _zslHeight;
+    int dw = _previewWidth;
+    int dh = _previewHeight;
+    // bytes per line as the driver lays capture frames out
+    int pitch = _v4l2Cam->getStride() ? _v4l2Cam->getStride() : sw * 2;
+
+    uint8_t* dstY = dst;
+    uint8_t* dstC = dst + dw * dh;
+    uint8_t* dstU;
+    uint8_t* dstV;
+    int step;
+
+    if (_previewPixfmt == V4L2_PIX_FMT_NV12) {
+        dstU = dstC;
+        dstV = dstC + 1;
+        step = 2;
+    } else if (_previewPixfmt == V4L2_PIX_FMT_NV21) {
+        dstV = dstC;
+        dstU = dstC + 1;
+        step = 2;
+    } else {
+        dstU = dstC;
+        dstV = dstC + dw * dh / 4;
+        step = 1;
+    }
+
+    for (int y = 0; y < dh; y++) {
+        const uint8_t* row = src + (y * sh / dh) * pitch;
+
+        uint8_t* luma = dstY + y * dw;
+        for (int x = 0; x < dw; x++)
+            luma[x] = row[(x * sw / dw) * 2];
+
+        if (y & 1)
+            continue;
+
+        int off = (y / 2) * (dw / 2) * step;
+        for (int x = 0; x < dw; x += 2) {
+            const uint8_t* pair = row + ((x * sw / dw) & ~1) * 2;
+            dstU[off] = pair[1];
+            dstV[off] = pair[3];
+            off += step;
+        }
+    }
+}
+
 // ======================================================================
 // Auto Focus
 
@@ -501,6 +1469,12 @@ bool SecCamera::getAutoFocusResult(void)
 // ======================================================================
 // Settings
 
+// Only sizes the buffer sets; the sensor keeps running at its own rate.
+void SecCamera::setFrameRate(int frame_rate)
+{
+    _frameRate = frame_rate;
+}
+
 int SecCamera::setRotate(int angle)
 {
     int rotate = angle % 360;
@@ -513,6 +1487,21 @@ int SecCamera::setRotate(int angle)
     return 0;
 }
 
+// Sensor controls set in between are sent to the driver all at once by
+// commitParams(), rather than one I2C round trip each.
+int SecCamera::beginParams(void)
+{
+    return _v4l2Cam->beginCtrls();
+}
+
+int SecCamera::commitParams(void)
+{
+    int ret = _v4l2Cam->commitCtrls();
+    LOGE_IF(ret, "%s: Failed to set some of the controls!", __func__);
+
+    return ret;
+}
+
 int SecCamera::setSceneMode(const char* strSceneMode)
 {
     _v4l2Params.scene_mode = _v4l2Cam->enumSceneMode(strSceneMode);
@@ -520,7 +1509,7 @@ int SecCamera::setSceneMode(const char* strSceneMode)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_SCENE_MODE,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_SCENE_MODE,
                                 _v4l2Params.scene_mode);
 
     LOGE_IF(0 > ret, "%s:Failed to set scene-mode, %s!! ret=%d",
@@ -540,7 +1529,7 @@ int SecCamera::setWhiteBalance(const char* strWhiteBalance)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_WHITE_BALANCE,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_WHITE_BALANCE,
                                 _v4l2Params.white_balance);
 
     LOGE_IF(0 > ret, "%s:Failed to set white-balance, %s!! ret=%d",
@@ -556,7 +1545,7 @@ int SecCamera::setEffect(const char* strEffect)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_EFFECT,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_EFFECT,
                                 _v4l2Params.effects);
 
     LOGE_IF(0 > ret, "%s:Failed to set effects, %s!! ret=%d",
@@ -587,7 +1576,7 @@ int SecCamera::setFlashMode(const char* strFlashMode)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_FLASH_MODE,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_FLASH_MODE,
                                 _v4l2Params.flash_mode);
 
     LOGE_IF(0 > ret, "%s:Failed to set flash-mode, %s!! ret=%d",
@@ -603,7 +1592,7 @@ int SecCamera::setBrightness(int brightness)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_BRIGHTNESS,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_BRIGHTNESS,
                                 _v4l2Params.brightness);
 
     LOGE_IF(0 > ret, "%s:Failed to set brightness, %d!! ret=%d",
@@ -619,7 +1608,7 @@ int SecCamera::setFocusMode(const char* strFocusMode)
     if (!_isPreviewOn)
         return 0;
 
-    int ret = _v4l2Cam->setCtrl(V4L2_CID_CAMERA_FOCUS_MODE,
+    int ret = _v4l2Cam->addCtrl(V4L2_CID_CAMERA_FOCUS_MODE,
                                 _v4l2Params.focus_mode);
 
     LOGE_IF(0 > ret, "%s:Failed to set focus-mode, %s!! ret=%d",
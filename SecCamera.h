@@ -17,14 +17,61 @@
 #ifndef __ANDROID_HARDWARE_LIBCAMERA_SEC_CAMERA_H__
 #define __ANDROID_HARDWARE_LIBCAMERA_SEC_CAMERA_H__
 
+#include <utils/threads.h>
 #include "SecV4L2Adapter.h"
+#include "SecV4L2Reactor.h"
 #include "EncoderInterface.h"
 #include "TaggerInterface.h"
 
 #define DUAL_PORT_RECORDING
+#define DUAL_PORT_CAPTURE
+
+// ids of streams for SecCamera::waitStreams()
+#define CAMERA_STREAM_PREVIEW   (1 << 0)
+#define CAMERA_STREAM_RECORD    (1 << 1)
+
+// memory all capture buffers of the camera may take, in KB
+#define CAMERA_BUF_BUDGET_PROP  "camera.buffer.budget_kb"
+#define CAMERA_BUF_BUDGET_DEF   (24 * 1024)
+// how long the video encoder keeps a recording frame before returning it
+#define CAMERA_ENC_HOLD_PROP    "camera.encoder.hold_ms"
+#define CAMERA_ENC_HOLD_DEF     (100)
+// frames kept back for zero shutter lag capture
+#define CAMERA_ZSL_FRAMES_PROP  "camera.zsl.frames"
+#define CAMERA_ZSL_FRAMES_DEF   (3)
+
+// "1" lets preview capture straight into the buffers of the preview
+// window when formats match, see setPreviewUserBufs()
+#define CAMERA_DIRECT_PREVIEW_PROP  "camera.preview.direct"
+
+// "1" runs the preview node in its tiled NV12T layout when it has one and
+// the callback format is NV12 or NV21. Frames are de-tiled as consumers
+// take them, see getPreviewCbPixfmt(). "2" also captures them at twice
+// the preview size each way, when the node lists that size, and halves
+// them while de-tiling, see getPreviewShift()
+#define CAMERA_TILED_PREVIEW_PROP   "camera.preview.tiled"
+
+// "1" takes stills on a capture node of their own while preview keeps
+// streaming. That node only scales what the sensor puts out for preview,
+// so it is used only for pictures no larger than the preview frames
+#define CAMERA_SIDE_CAPTURE_PROP    "camera.capture.side"
+
+// how often drop counters are sampled, and the share of frames lost over
+// the rolling window, in per mille, that calls the drop callback
+#define CAMERA_DROP_INTERVAL_PROP   "camera.drops.interval_ms"
+#define CAMERA_DROP_INTERVAL_DEF    (1000)
+#define CAMERA_DROP_ALARM_PROP      "camera.drops.alarm_permille"
+#define CAMERA_DROP_ALARM_DEF       (50)
+
+// most pictures a single takePicture() can burst
+#define CAMERA_MAX_BURST        (10)
 
 namespace android {
 
+// called when a stream starts losing more frames than the alarm level
+typedef void (*camera_drop_callback)(void* user, const char* stream,
+                                     unsigned int permille);
+
 class SecCamera {
 public:
     SecCamera(int ch);
@@ -33,14 +80,37 @@ public:
     int                 startPreview(void);
     int                 stopPreview(void);
     void                pausePreview();
-    int                 dqPreviewBuffer(int* index, unsigned int* addrY, unsigned int* addrC);
+    int                 waitStreams(int timeout);
+    void                cancelWaits(void);
+    void                setDropCallback(camera_drop_callback cb, void* user);
+    int                 getDropInterval(void);
+    void                sampleDrops(void);
+    int                 setDeliveryPolicy(int streams, int policy, int maxAgeMs = 0);
+    int                 dqPreviewBuffer(int* index, unsigned int* addrY, unsigned int* addrC,
+                                        SecV4L2FrameInfo* info = NULL);
     void                qPreviewBuffer(int index);
+    int                 getPreviewBufFd(int index);
+    int                 getPreviewPlaneCnt(void);
+    int                 getPreviewPlane(int index, int plane, void** start, size_t* size);
+    int                 getPreviewBufCnt(void);
+    int                 getPreviewPixfmt(void);
+    int                 getPreviewCbPixfmt(void);
+    int                 getPreviewStride(void);
+    int                 getPreviewShift(void);
+    int                 setPreviewUserBufs(unsigned int n);
+    int                 setPreviewUserBuf(int index, void* start, size_t size);
+    bool                isPreviewUserBufs(void);
+    void                setPreviewHeld(unsigned int n);
 
 #ifdef DUAL_PORT_RECORDING
     int                 startRecord(void);
     int                 stopRecord(void);
-    int                 dqRecordBuffer(int* index, unsigned int* addrY, unsigned int* addrC);
+    int                 dqRecordBuffer(int* index, unsigned int* addrY, unsigned int* addrC,
+                                       SecV4L2FrameInfo* info = NULL);
     void                qRecordBuffer(int index);
+    int                 getRecordBufFd(int index);
+    int                 getRecordAddr(int index, unsigned int* addrY, unsigned int* addrC);
+    int                 getRecordBufCnt(void);
 #endif
 
     int                 setPreviewFormat(int width, int height, const char* strPixfmt);
@@ -48,11 +118,21 @@ public:
     void                getPreviewFrameSize(int* width, int* height, int* frameSize);
 
     int                 setSnapshotFormat(int width, int height, const char* strPixfmt);
+    int                 setZsl(bool on);
+    bool                isZslCapture(void);
+    bool                isSideCapture(void);
+    int                 setBurstCount(int count);
+    int                 getBurstCount(void);
+
+    int                 getSupportedSizes(const char* strPixfmt, String8& values);
+    int                 getSupportedFrameRates(const char* strPixfmt, String8& values);
 
     int                 startAutoFocus(void);
     int                 abortAutoFocus(void);
     bool                getAutoFocusResult(void);
 
+    int                 beginParams(void);
+    int                 commitParams(void);
     int                 setSceneMode(const char* strScenemode);
     int                 setWhiteBalance(const char* strWhitebalance);
     int                 setEffect(const char* strEffect);
@@ -64,10 +144,14 @@ public:
     void                setFrameRate(int frame_rate);
     int                 setZoom(int zoom);
 
-    int                 startSnapshot(size_t* captureSize);
+    int                 startSnapshot(size_t* captureSize, nsecs_t shutterTime = 0);
+    int                 setSnapshotBuffer(uint8_t* buffer, size_t size);
     int                 getSnapshot(int xth = 0);
     int                 getRawSnapshot(uint8_t* buffer, size_t size);
     int                 endSnapshot(void);
+    int                 getBurstFrame(nsecs_t* timestamp);
+    int                 getBurstFrameData(int index, uint8_t** data, size_t* size);
+    void                releaseBurstFrame(int index);
 
     int                 setPictureQuality(int q);
     int                 setThumbnailQuality(int q);
@@ -83,6 +167,7 @@ public:
                                    const char* strProcessMethod = NULL);
 
     int                 getFd(void);
+    void                dump(String8& result);
 
 private:
     struct sec_cam_parm _v4l2Params;
@@ -92,6 +177,12 @@ private:
     int                 _previewWidth;
     int                 _previewHeight;
     int                 _previewPixfmt;
+    // what the driver captures into, set by startPreview()
+    int                 _previewDrvPixfmt;
+    bool                _tiledPreview;
+    bool                _halvedPreview;
+    // captured frames are 1 << _previewShift the preview size each way
+    int                 _previewShift;
     unsigned int        _previewFrameSize;
 
     int                 _snapshotWidth;
@@ -101,8 +192,76 @@ private:
     bool                _isPreviewOn;
     bool                _isRecordOn;
 
+    // preview buffers handed in by the caller. _previewUserBufCnt is 0
+    // for buffers of the driver
+    struct userBuf {
+        void* start;
+        size_t size;
+    };
+    bool                _directPreview;
+    unsigned int        _previewUserBufCnt;
+    struct userBuf      _previewUserBufs[MAX_CAM_BUFFERS];
+    bool                _isPreviewUserBufs;
+    // dequeued preview frames the caller keeps before requeueing
+    unsigned int        _previewHeld;
+
+    int                 _recordPolicy;
+    int                 _recordMaxAge;
+
+    int                 _frameRate;
+    size_t              _bufBudget;
+    unsigned int        _encoderHoldMs;
+
+    // zero shutter lag. the sensor streams at picture size into the
+    // preview buffers; the newest of them are kept back in _zslRing,
+    // oldest first. Each buffer is scaled down for preview into its own
+    // slot of _zslPreview, which stays the preview consumer's until
+    // qPreviewBuffer(); a buffer isn't requeued while its slot is out.
+    struct zslFrame {
+        int index;
+        nsecs_t timestamp;
+    };
+    Mutex               _zslLock;
+    bool                _zslEnabled;
+    bool                _isZslOn;
+    int                 _zslWidth;
+    int                 _zslHeight;
+    unsigned int        _zslFrameCnt;
+    struct zslFrame     _zslRing[MAX_CAM_BUFFERS];
+    unsigned int        _zslRingCnt;
+    unsigned int        _zslRingMax;
+    int                 _zslCaptureIdx;
+    uint8_t*            _zslPreview;
+    size_t              _zslPreviewSize;
+    size_t              _zslSlotSize;
+    bool                _zslShown[MAX_CAM_BUFFERS];
+    bool                _zslDone[MAX_CAM_BUFFERS];
+    unsigned int        _zslCaptures;
+    nsecs_t             _zslLagTotal;
+
+    // pictures per takePicture(). more than one streams the sensor in
+    // capture mode; frames go back to it by releaseBurstFrame()
+    int                 _burstCount;
+    bool                _isBurstOn;
+
+    // drop monitoring. _dropAlarms has a CAMERA_STREAM_* bit set while
+    // that stream is over the alarm level, so the callback fires once.
+    // _streamLock is held while the streams are started or stopped, and
+    // by sampleDrops(), which runs on a thread of its own
+    Mutex               _streamLock;
+    int                 _dropInterval;
+    unsigned int        _dropAlarm;
+    unsigned int        _dropAlarms;
+    camera_drop_callback _dropCb;
+    void*               _dropUser;
+
     SecV4L2Adapter*     _v4l2Cam;
     SecV4L2Adapter*     _v4l2Rec;
+    // still capture alongside preview, and the node of the current one
+    SecV4L2Adapter*     _v4l2Cap;
+    SecV4L2Adapter*     _snapshotNode;
+    bool                _sideCapture;
+    SecV4L2Reactor*     _reactor;
 
     EncoderInterface*   _encoder;
     EncoderParams       _pictureParams;
@@ -111,6 +270,21 @@ private:
     void                _release(void);
     void                _initParms(void);
     int                 _getPhyAddr(int index, unsigned int* addrY, unsigned int* addrC);
+    int                 _startSnapshotStream(int memory, unsigned int n = 1);
+    void                _loadBufConfig(void);
+    void                _openSideCapture(void);
+    void                _checkDrops(SecV4L2Adapter* node, const char* name,
+                                    unsigned int stream);
+    bool                _canZsl(void);
+    bool                _hasTiledPreview(void);
+    bool                _hasTiledSize(int w, int h);
+    int                 _startZsl(unsigned int bufCnt);
+    int                 _pushZslFrame(int index, nsecs_t timestamp);
+    int                 _pickZslFrame(nsecs_t shutterTime);
+    void                _scaleZslPreview(const uint8_t* src, uint8_t* dst);
+    void                _releaseZslBuf(int index);
+    unsigned int        _getBufCnt(int w, int h, int pixfmt, unsigned int held,
+                                   size_t budget);
 
     TaggerInterface*    _tagger;
     TaggerParams        _exifParams;
@@ -23,6 +23,10 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <cutils/atomic.h>
 
 #include <camera/CameraParameters.h>
 
@@ -255,12 +259,63 @@ unsigned int SecV4L2Adapter::frameSize()
     return _bufSize;
 }
 
+unsigned int SecV4L2Adapter::getBufCnt(void)
+{
+    return _bufCnt;
+}
+
+int SecV4L2Adapter::getStride(void)
+{
+    return _stride;
+}
+
 SecV4L2Adapter::SecV4L2Adapter(const char* path, int ch):
     _fd(0),
     _chIdx(-1),
+    _dev(SecV4L2Device::create()),
+    _bufType(V4L2_BUF_TYPE_VIDEO_CAPTURE),
     _bufCnt(0),
-    _bufSize(0)
+    _bufSize(0),
+    _imageSize(0),
+    _stride(0),
+    _memory(V4L2_MEMORY_MMAP),
+    _policy(DELIVER_FIFO),
+    _maxAge(0),
+    _queuedCnt(0),
+    _seqValid(false),
+    _lastSeq(0),
+    _starved(false),
+    _hasDropCtrls(true),
+    _dropWindowCnt(0),
+    _dropWindowIdx(0),
+    _bufs(NULL),
+    _planeCnt(1),
+    _batchCtrls(false),
+    _extCtrls(true),
+    _pendingCtrlCnt(0),
+    _parmValid(false),
+    _ctrlValid(0),
+    _ctrlHits(0),
+    _ctrlMisses(0),
+    _parmHits(0),
+    _parmMisses(0)
 {
+    memset(&_parmShadow, 0, sizeof(_parmShadow));
+    memset(_skippedFrames, 0, sizeof(_skippedFrames));
+    memset(&_drops, 0, sizeof(_drops));
+    memset(&_dropRates, 0, sizeof(_dropRates));
+    memset(_planeSize, 0, sizeof(_planeSize));
+    memset(&_bufSetKey, 0, sizeof(_bufSetKey));
+
+    _cancelPipe[0] = _cancelPipe[1] = -1;
+    if (pipe(_cancelPipe) < 0) {
+        LOGE("%s: pipe() failed (%s)", __func__, strerror(errno));
+        _cancelPipe[0] = _cancelPipe[1] = -1;
+    } else {
+        fcntl(_cancelPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(_cancelPipe[1], F_SETFL, O_NONBLOCK);
+    }
+
     LOGI("opening %s (ch=%d)...", path, ch);
     int err = 0;
     err |= _openCamera(path);
@@ -270,24 +325,32 @@ SecV4L2Adapter::SecV4L2Adapter(const char* path, int ch):
         LOGE("!! V4L2 init failed !! path=%s, ch=%d", path, ch);
 
         if (_fd) {
-            close(_fd);
+            _dev->close();
             _fd = 0;
         }
+    } else {
+        _caps.load(_dev, _bufType, _chIdx);
     }
 
-    for (int i = 0; i < MAX_CAM_BUFFERS; i++) {
-        _bufMapStart[i];
-    }
     LOGI("opened %s (ch=%d)...", path, ch);
 }
 
 SecV4L2Adapter::~SecV4L2Adapter()
 {
     LOGI("%s", __func__);
+    flushBufs();
+
     if (_fd) {
-        close(_fd);
+        _dev->close();
         _fd = 0;
     }
+
+    delete _dev;
+
+    for (int i = 0; i < 2; i++) {
+        if (_cancelPipe[i] >= 0)
+            close(_cancelPipe[i]);
+    }
 }
 
 int SecV4L2Adapter::_openCamera(const char* path)
@@ -295,10 +358,10 @@ int SecV4L2Adapter::_openCamera(const char* path)
     LOG_CAMERA_FUNC_ENTER;
     if (_fd) {
         LOGW("fd(%d) already opened. close it first!", _fd);
-        close(_fd);
+        _dev->close();
     }
 
-    _fd = open(path, O_RDWR);
+    _fd = _dev->open(path);
     if (0 >= _fd) {
         LOGE("ERR(%s):Cannot open %s (error : %s)\n",
              __func__, path, strerror(errno));
@@ -306,13 +369,18 @@ int SecV4L2Adapter::_openCamera(const char* path)
     }
 
     struct v4l2_capability cap;
-    int ret = ioctl(_fd, VIDIOC_QUERYCAP, &cap);
+    int ret = _ioctl(VIDIOC_QUERYCAP, &cap);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_QUERYCAP failed\n", __func__);
         return -1;
     }
 
-    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+    if (cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) {
+        _bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    } else if (cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        LOGI("%s: %s is a multi-planar device", __func__, path);
+        _bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    } else {
         LOGE("ERR(%s):no capture devices\n", __func__);
         return -1;
     }
@@ -342,13 +410,13 @@ int SecV4L2Adapter::_setInputChann(int ch)
 
     LOGI("%s: enum chan", __func__);
     input.index = ch;
-    if (ioctl(_fd, VIDIOC_ENUMINPUT, &input) != 0) {
+    if (_ioctl(VIDIOC_ENUMINPUT, &input) != 0) {
         LOGE("ERR(%s):No matching index found\n", __func__);
         return -1;
     }
 
     LOGI("%s: set input", __func__);
-    ret = ioctl(_fd, VIDIOC_S_INPUT, &input);
+    ret = _ioctl(VIDIOC_S_INPUT, &input);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_INPUT failed\n", __func__);
         return ret;
@@ -361,27 +429,33 @@ int SecV4L2Adapter::_setInputChann(int ch)
     return 0;
 }
 
+bool SecV4L2Adapter::isMplane(void)
+{
+    return _bufType == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+int SecV4L2Adapter::getPlaneCnt(void)
+{
+    return _planeCnt;
+}
+
+bool SecV4L2Adapter::_hasFmt(unsigned int fmt)
+{
+    return _caps.hasFmt(fmt);
+}
+
 int SecV4L2Adapter::_setFmt(int w, int h, unsigned int fmt, int flag)
 {
     LOG_CAMERA_FUNC_ENTER;
     int ret;
 
-    struct v4l2_fmtdesc fmtdesc;
-    fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmtdesc.index = 0;
-
-    int found = 0;
-    while (ioctl(_fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
-        if (fmtdesc.pixelformat == fmt) {
-            LOGI("passed fmt = %s found pixel format[%d]: %s\n",
-                 getStrFourCC(fmt), fmtdesc.index, fmtdesc.description);
-            found = 1;
-            break;
-        }
-        fmtdesc.index++;
+    if (isMplane()) {
+        LOGW_IF(flag, "%s: flag %d ignored on multi-planar device",
+                __func__, flag);
+        return _setFmtMplane(w, h, fmt);
     }
 
-    if (!found) {
+    if (!_hasFmt(fmt)) {
         LOGE("unsupported pixel format, %d\n", fmt);
         return -1;
     }
@@ -404,26 +478,107 @@ int SecV4L2Adapter::_setFmt(int w, int h, unsigned int fmt, int flag)
     v4l2_fmt.fmt.pix = pixfmt;
 
     /* Set up for capture */
-    ret = ioctl(_fd, VIDIOC_S_FMT, &v4l2_fmt);
+    ret = _ioctl(VIDIOC_S_FMT, &v4l2_fmt);
+    if (ret < 0) {
+        LOGE("%s: VIDIOC_S_FMT failed!", __func__);
+        return -1;
+    }
+
+    _imageSize = v4l2_fmt.fmt.pix.sizeimage;
+    _stride = v4l2_fmt.fmt.pix.bytesperline;
+    _planeCnt = 1;
+    _planeSize[0] = _imageSize;
+
+    return ret;
+}
+
+// non-contiguous variant of a pixel format, which is what multi-planar
+// drivers usually list instead of the one the HAL asks for.
+static unsigned int _mplaneFourCC(unsigned int fmt)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_NV12:
+        return V4L2_PIX_FMT_NV12M;
+#ifdef V4L2_PIX_FMT_NV21M
+    case V4L2_PIX_FMT_NV21:
+        return V4L2_PIX_FMT_NV21M;
+#endif
+    case V4L2_PIX_FMT_YUV420:
+        return V4L2_PIX_FMT_YUV420M;
+#ifdef V4L2_PIX_FMT_NV12MT
+    case V4L2_PIX_FMT_NV12T:
+        return V4L2_PIX_FMT_NV12MT;
+#endif
+    default:
+        return fmt;
+    }
+}
+
+int SecV4L2Adapter::_setFmtMplane(int w, int h, unsigned int fmt)
+{
+    LOG_CAMERA_FUNC_ENTER;
+    int ret;
+
+    if (!_hasFmt(fmt)) {
+        unsigned int fmtM = _mplaneFourCC(fmt);
+        if (fmtM == fmt || !_hasFmt(fmtM)) {
+            LOGE("unsupported pixel format, %d\n", fmt);
+            return -1;
+        }
+        fmt = fmtM;
+    }
+
+    struct v4l2_format v4l2_fmt;
+    memset(&v4l2_fmt, 0, sizeof(v4l2_fmt));
+
+    v4l2_fmt.type = _bufType;
+    v4l2_fmt.fmt.pix_mp.width = w;
+    v4l2_fmt.fmt.pix_mp.height = h;
+    v4l2_fmt.fmt.pix_mp.pixelformat = fmt;
+    v4l2_fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+
+    // number of planes and their sizes are up to the driver
+    ret = _ioctl(VIDIOC_S_FMT, &v4l2_fmt);
     if (ret < 0) {
         LOGE("%s: VIDIOC_S_FMT failed!", __func__);
         return -1;
     }
 
+    unsigned int n = v4l2_fmt.fmt.pix_mp.num_planes;
+    if (n == 0 || n > MAX_CAM_PLANES) {
+        LOGE("%s: unsupported number of planes, %u", __func__, n);
+        return -1;
+    }
+
+    _planeCnt = n;
+    _imageSize = 0;
+    _stride = v4l2_fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    for (unsigned int p = 0; p < n; p++) {
+        _planeSize[p] = v4l2_fmt.fmt.pix_mp.plane_fmt[p].sizeimage;
+        _imageSize += _planeSize[p];
+        LOGV("%s: plane-%u sizeimage = %d", __func__, p, _planeSize[p]);
+    }
+
     return ret;
 }
 
-int SecV4L2Adapter::_reqBufs(int n)
+int SecV4L2Adapter::_reqBufs(int n, int memory)
 {
     LOG_CAMERA_FUNC_ENTER;
     struct v4l2_requestbuffers req;
     int ret;
 
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
+    req.type = _bufType;
+    req.memory = memory;
     req.count = n;
 
-    ret = ioctl(_fd, VIDIOC_REQBUFS, &req);
+    ret = _ioctl(VIDIOC_REQBUFS, &req);
+    if (ret < 0 && memory != V4L2_MEMORY_MMAP) {
+        LOGW("%s: memory type %d rejected. falling back to mmap",
+             __func__, memory);
+        return _reqBufs(n, V4L2_MEMORY_MMAP);
+    }
+
     if (ret < 0) {
         LOGE("%s: VIDIOC_REQBUFS failed!", __func__);
         return -1;
@@ -431,48 +586,111 @@ int SecV4L2Adapter::_reqBufs(int n)
 
     LOGW_IF(n != 1 && req.count == 1, "insufficient buffer avaiable!");
 
-    _bufCnt = req.count;
+    _memory = memory;
+    _queuedCnt = 0;
+
+    return _allocBufTable(req.count);
+}
+
+// The table follows whatever count the driver granted; it is sized per
+// buffer set, not for the largest set there could be.
+int SecV4L2Adapter::_allocBufTable(unsigned int n)
+{
+    _freeBufTable();
+
+    if (n == 0)
+        return -1;
+
+    _bufs = new camBuf[n];
+    if (_bufs == NULL) {
+        LOGE("%s: no memory for %u buffers!", __func__, n);
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        for (int p = 0; p < MAX_CAM_PLANES; p++) {
+            _bufs[i].start[p] = NULL;
+            _bufs[i].fd[p] = -1;
+        }
+        _bufs[i].addrValid = false;
+    }
+    _bufCnt = n;
 
     return 0;
 }
 
+void SecV4L2Adapter::_freeBufTable(void)
+{
+    delete[] _bufs;
+    _bufs = NULL;
+    _bufCnt = 0;
+}
+
+void SecV4L2Adapter::_initBuf(struct v4l2_buffer* buf,
+                              struct v4l2_plane* planes,
+                              int memory, int idx)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->type = _bufType;
+    buf->memory = memory;
+    buf->index = idx;
+
+    if (isMplane()) {
+        memset(planes, 0, sizeof(struct v4l2_plane) * MAX_CAM_PLANES);
+        buf->m.planes = planes;
+        buf->length = _planeCnt;
+    }
+}
+
+// length and offset, if given, take one entry per plane
 int SecV4L2Adapter::_queryBuf(int idx, int* length, int* offset)
 {
     LOG_CAMERA_FUNC_ENTER;
     struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_CAM_PLANES];
     int ret;
 
-    v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    v4l2_buf.memory = V4L2_MEMORY_MMAP;
-    v4l2_buf.index = idx;
+    _initBuf(&v4l2_buf, planes, V4L2_MEMORY_MMAP, idx);
 
-    ret = ioctl(_fd, VIDIOC_QUERYBUF, &v4l2_buf);
+    ret = _ioctl(VIDIOC_QUERYBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("%s: VIDIOC_QUERYBUF failed!", __func__);
         return -1;
     }
 
-    int l = v4l2_buf.length;
-    int o = v4l2_buf.m.offset;
-    LOGV("buffer-%d: length = %d, offset = %d", idx, l, o);
+    size_t total = 0;
+    for (unsigned int p = 0; p < _planeCnt; p++) {
+        int l, o;
+        if (isMplane()) {
+            l = planes[p].length;
+            o = planes[p].m.mem_offset;
+        } else {
+            l = v4l2_buf.length;
+            o = v4l2_buf.m.offset;
+        }
+        LOGV("buffer-%d.%u: length = %d, offset = %d", idx, p, l, o);
+
+        _planeSize[p] = l;
+        total += l;
+
+        if (length)
+            length[p] = l;
+        if (offset)
+            offset[p] = o;
+    }
 
     if (_bufSize == 0)
-        _bufSize = l;
+        _bufSize = total;
 
-    LOGE_IF(_bufSize != (size_t)l,
+    LOGE_IF(_bufSize != total,
             "%s: Invaild length! _bufSize = %d, l = %d", __func__,
-            _bufSize, l);
-
-    if (length)
-        *length = l;
-    if (offset)
-        *offset = o;
+            _bufSize, total);
 
     return 0;
 }
 
 int SecV4L2Adapter::setupBufs(int w, int h, unsigned int fmt, unsigned int n,
-                              int flag)
+                              int flag, int memory)
 {
     LOG_CAMERA_FUNC_ENTER;
     if (_fd == 0) {
@@ -480,78 +698,308 @@ int SecV4L2Adapter::setupBufs(int w, int h, unsigned int fmt, unsigned int n,
         return -1;
     }
 
+    struct bufSetKey key;
+    memset(&key, 0, sizeof(key));
+    key.w = w;
+    key.h = h;
+    key.fmt = fmt;
+    key.n = n;
+    key.flag = flag;
+    key.memory = memory;
+
+    if (_isBufSetCached(&key)) {
+        LOGV("%s: reusing %d buffers of %dx%d(%s)", __func__,
+             _bufCnt, w, h, getStrFourCC(fmt));
+        return _bufCnt;
+    }
+
+    flushBufs();
+
+    // the sensor is reconfigured for a new format. don't trust the
+    // shadowed controls past this point
+    _invalidateShadow();
+
     int err;
     err = _setFmt(w, h, fmt, flag);
     if (err)
         return -1;
 
-    _reqBufs(n);
+    if (n > MAX_CAM_BUFFERS) {
+        LOGW("%s: %u buffers requested, capped to %d",
+             __func__, n, MAX_CAM_BUFFERS);
+        n = MAX_CAM_BUFFERS;
+    }
+
+    _reqBufs(n, memory);
     if (_bufCnt == 0)
         return -1;
 
     LOGW_IF(n > _bufCnt, "only %d buffers available! req = %d", _bufCnt, n);
 
+    _bufSetKey = key;
+
+    if (_memory == V4L2_MEMORY_USERPTR) {
+        // no driver buffers to query. callers hand theirs in by setUserBuf()
+        _bufSize = _imageSize;
+        return _bufCnt;
+    }
+
     for (unsigned int i = 0; i < _bufCnt; i++) {
         _queryBuf(i, NULL, NULL);
     }
 
+    _resolveAddrs();
+
     // return available buffer count;
     return _bufCnt;
 }
 
-int SecV4L2Adapter::mapBuf(int idx)
+bool SecV4L2Adapter::_isBufSetCached(const struct bufSetKey* key)
 {
-    int length;
-    int offset;
-    int err = _queryBuf(idx, &length, &offset);
-    if (err || length == 0) {
-        LOGE("%s: aborted mmap-%d!", __func__, idx);
+    if (_bufCnt == 0)
+        return false;
+
+    return (key->w == _bufSetKey.w &&
+            key->h == _bufSetKey.h &&
+            key->fmt == _bufSetKey.fmt &&
+            key->n == _bufSetKey.n &&
+            key->flag == _bufSetKey.flag &&
+            key->memory == _bufSetKey.memory);
+}
+
+int SecV4L2Adapter::setUserBuf(int idx, void* start, size_t size)
+{
+    if (_memory != V4L2_MEMORY_USERPTR) {
+        LOGE("%s: buffers are not in userptr mode!", __func__);
         return -1;
     }
 
-    void* start = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED,
-                       _fd, offset);
-    if (start == MAP_FAILED) {
-        LOGE("%s: mmap() failed. idx = %d, length = %d, offset = %d",
-             __func__, idx, length, offset);
+    if (idx < 0 || (unsigned int)idx >= _bufCnt || start == NULL) {
+        LOGE("%s: invalid buffer-%d, %p", __func__, idx, start);
         return -1;
     }
 
-    if (_bufMapStart[idx] != NULL) {
-        LOGE("%s: mmaped alread in %d!", __func__, idx);
+    if (size < _bufSize) {
+        LOGE("%s: buffer-%d too small. size = %d, expected = %d",
+             __func__, idx, size, _bufSize);
         return -1;
     }
 
-    _bufMapStart[idx] = start;
+    _bufs[idx].start[0] = start;
 
     return 0;
 }
 
+int SecV4L2Adapter::getMemory(void)
+{
+    return _memory;
+}
+
+int SecV4L2Adapter::mapBuf(int idx)
+{
+    if (idx < 0 || (unsigned int)idx >= _bufCnt) {
+        LOGE("%s: invalid index, %d!", __func__, idx);
+        return -1;
+    }
+
+    // still mapped from a cached buffer set
+    if (_bufs[idx].start[0] != NULL)
+        return 0;
+
+    int length[MAX_CAM_PLANES];
+    int offset[MAX_CAM_PLANES];
+    int err = _queryBuf(idx, length, offset);
+    if (err) {
+        LOGE("%s: aborted mmap-%d!", __func__, idx);
+        return -1;
+    }
+
+    for (unsigned int p = 0; p < _planeCnt; p++) {
+        if (length[p] == 0) {
+            LOGE("%s: aborted mmap-%d.%u!", __func__, idx, p);
+            _unmapBuf(idx);
+            return -1;
+        }
+
+        void* start = _dev->mmap(length[p], offset[p]);
+        if (start == MAP_FAILED) {
+            LOGE("%s: mmap() failed. idx = %d.%u, length = %d, offset = %d",
+                 __func__, idx, p, length[p], offset[p]);
+            _unmapBuf(idx);
+            return -1;
+        }
+
+        _bufs[idx].start[p] = start;
+    }
+
+    return 0;
+}
+
+void SecV4L2Adapter::_unmapBuf(int idx)
+{
+    for (unsigned int p = 0; p < _planeCnt; p++) {
+        if (_bufs[idx].start[p] == NULL)
+            continue;
+
+        if (_memory != V4L2_MEMORY_USERPTR) {
+            _dev->munmap(_bufs[idx].start[p], _planeSize[p]);
+            LOGV("munmap-%d.%u : addr = 0x%p size = %d\n",
+                 idx, p, _bufs[idx].start[p], _planeSize[p]);
+        }
+        // user buffers are owned by the caller
+        _bufs[idx].start[p] = NULL;
+    }
+}
+
+// Whole buffer of a single-planar set. Multi-planar buffers aren't
+// contiguous; only their first plane is given here, see mapPlaneInfo().
 int SecV4L2Adapter::mapBufInfo(int idx, void** start, size_t* size)
 {
+    if (idx < 0 || (unsigned int)idx >= _bufCnt) {
+        LOGE("%s: invalid index, %d!", __func__, idx);
+        return -1;
+    }
+
     if (size)
-        *size = _bufSize;
+        *size = _planeCnt > 1 ? _planeSize[0] : _bufSize;
     if (start)
-        *start = _bufMapStart[idx];
+        *start = _bufs[idx].start[0];
     return 0;
 }
 
-int SecV4L2Adapter::closeBufs()
+int SecV4L2Adapter::mapPlaneInfo(int idx, int plane, void** start,
+                                 size_t* size)
 {
-    LOG_CAMERA_FUNC_ENTER;
+    if (idx < 0 || (unsigned int)idx >= _bufCnt ||
+        plane < 0 || (unsigned int)plane >= _planeCnt) {
+        LOGE("%s: invalid buffer-%d.%d", __func__, idx, plane);
+        return -1;
+    }
+
+    if (size)
+        *size = _planeSize[plane];
+    if (start)
+        *start = _bufs[idx].start[plane];
+    return 0;
+}
 
+int SecV4L2Adapter::_exportBuf(int idx, int plane)
+{
+#ifdef VIDIOC_EXPBUF
+    struct v4l2_exportbuffer expbuf;
+    int ret;
+
+    memset(&expbuf, 0, sizeof(expbuf));
+    expbuf.type = _bufType;
+    expbuf.index = idx;
+    expbuf.plane = plane;
+    expbuf.flags = O_CLOEXEC | O_RDWR;
+
+    ret = _ioctl(VIDIOC_EXPBUF, &expbuf);
+    if (ret < 0) {
+        LOGV("%s: VIDIOC_EXPBUF failed for buffer-%d.%d (%s)",
+             __func__, idx, plane, strerror(errno));
+        return -1;
+    }
+
+    LOGV("buffer-%d.%d: exported as dma-buf fd %d", idx, plane, expbuf.fd);
+    _bufs[idx].fd[plane] = expbuf.fd;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void SecV4L2Adapter::_closeBufFds(void)
+{
     for (unsigned int i = 0; i < _bufCnt; i++) {
-        if (_bufMapStart[i] == NULL)
-            continue;
+        for (int p = 0; p < MAX_CAM_PLANES; p++) {
+            if (_bufs[i].fd[p] < 0)
+                continue;
 
-        munmap(_bufMapStart[i], _bufSize);
-        LOGV("munmap-%d : addr = 0x%p size = %d\n",
-             i, _bufMapStart[i], _bufSize);
-        _bufMapStart[i] = NULL;
+            close(_bufs[i].fd[p]);
+            _bufs[i].fd[p] = -1;
+        }
     }
+}
 
-    _bufCnt = 0;
+// Export every buffer of the current set as a dma-buf fd, so consumers can
+// map each buffer on its own instead of relying on the driver laying them
+// out back to back behind _fd. All or nothing; returns -1 if unsupported.
+int SecV4L2Adapter::exportBufs(void)
+{
+    LOG_CAMERA_FUNC_ENTER;
+    if (_fd == 0) {
+        LOGE("%s: camera not opened!", __func__);
+        return -1;
+    }
+
+    if (_memory != V4L2_MEMORY_MMAP)
+        return -1;
+
+    for (unsigned int i = 0; i < _bufCnt; i++) {
+        for (unsigned int p = 0; p < _planeCnt; p++) {
+            if (_bufs[i].fd[p] >= 0)
+                continue;
+
+            if (_exportBuf(i, p)) {
+                LOGW("%s: dma-buf export not available. "
+                     "consumers will map buffers through fd %d",
+                     __func__, _fd);
+                _closeBufFds();
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int SecV4L2Adapter::getBufFd(int idx)
+{
+    return getPlaneFd(idx, 0);
+}
+
+int SecV4L2Adapter::getPlaneFd(int idx, int plane)
+{
+    if (idx < 0 || (unsigned int)idx >= _bufCnt ||
+        plane < 0 || (unsigned int)plane >= _planeCnt)
+        return -1;
+
+    return _bufs[idx].fd[plane];
+}
+
+// Release the buffer set for this stream. Allocations, mappings and
+// exported fds are kept for a following setupBufs() with the same format;
+// they are only torn down by flushBufs() or when the format changes.
+// Streaming must be off already.
+int SecV4L2Adapter::closeBufs()
+{
+    LOG_CAMERA_FUNC_ENTER;
+
+    if (_memory != V4L2_MEMORY_USERPTR)
+        return 0;
+
+    // user buffers belong to the caller and may go away after this
+    for (unsigned int i = 0; i < _bufCnt; i++)
+        _unmapBuf(i);
+
+    return 0;
+}
+
+int SecV4L2Adapter::flushBufs()
+{
+    LOG_CAMERA_FUNC_ENTER;
+
+    _closeBufFds();
+
+    for (unsigned int i = 0; i < _bufCnt; i++)
+        _unmapBuf(i);
+
+    _freeBufTable();
     _bufSize = 0;
+    memset(&_bufSetKey, 0, sizeof(_bufSetKey));
 
     return 0;
 }
@@ -559,7 +1007,7 @@ int SecV4L2Adapter::closeBufs()
 int SecV4L2Adapter::startStream(bool on)
 {
     LOG_CAMERA_FUNC_ENTER;
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    enum v4l2_buf_type type = (enum v4l2_buf_type)_bufType;
     int ret;
 
     if (_fd == 0) {
@@ -567,19 +1015,31 @@ int SecV4L2Adapter::startStream(bool on)
         return -1;
     }
 
-    ret = ioctl(_fd, on ? VIDIOC_STREAMON : VIDIOC_STREAMOFF, &type);
+    if (on)
+        _clearCancel();
+
+    ret = _ioctl(on ? VIDIOC_STREAMON : VIDIOC_STREAMOFF, &type);
     if (ret < 0) {
         LOGE("ERR(%s): Failed stream %s", __func__,
              on ? "on" : "off");
         return ret;
     }
 
+    // sequences restart, and STREAMOFF hands back every buffer
+    _seqValid = false;
+    _starved = false;
+    if (!on)
+        _queuedCnt = 0;
+
+    // the shadow outlives a plain restart. setupBufs() drops it when the
+    // format changes, and a CAMERA_RESET when the sensor is reset
     return ret;
 }
 
 int SecV4L2Adapter::qBuf(unsigned int idx)
 {
     struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_CAM_PLANES];
     int ret;
 
     if (_fd == 0) {
@@ -592,22 +1052,69 @@ int SecV4L2Adapter::qBuf(unsigned int idx)
         return -1;
     }
 
-    v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    v4l2_buf.memory = V4L2_MEMORY_MMAP;
-    v4l2_buf.index = idx;
+    _initBuf(&v4l2_buf, planes, _memory, idx);
 
-    ret = ioctl(_fd, VIDIOC_QBUF, &v4l2_buf);
+    if (_memory == V4L2_MEMORY_USERPTR) {
+        char* start = (char*)_bufs[idx].start[0];
+        if (start == NULL) {
+            LOGE("%s: no user buffer set for %d!", __func__, idx);
+            return -1;
+        }
+
+        if (isMplane()) {
+            // planes follow each other in the caller's buffer
+            for (unsigned int p = 0; p < _planeCnt; p++) {
+                planes[p].m.userptr = (unsigned long)start;
+                planes[p].length = _planeSize[p];
+                start += _planeSize[p];
+            }
+        } else {
+            v4l2_buf.m.userptr = (unsigned long)start;
+            v4l2_buf.length = _bufSize;
+        }
+    }
+
+    ret = _ioctl(VIDIOC_QBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_QBUF failed\n", __func__);
         return ret;
     }
 
+    android_atomic_inc(&_queuedCnt);
+
     return 0;
 }
 
-int SecV4L2Adapter::dqBuf(void)
+void SecV4L2Adapter::_getFrameInfo(const struct v4l2_buffer* buf,
+                                   struct SecV4L2FrameInfo* info)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t ts = seconds_to_nanoseconds(buf->timestamp.tv_sec) +
+                 us2ns(buf->timestamp.tv_usec);
+
+    if (ts == 0) {
+        // driver doesn't stamp frames
+        ts = now;
+    } else {
+        // older drivers stamp with gettimeofday(). move those stamps
+        // over to the monotonic clock that the callbacks use.
+        nsecs_t real = systemTime(SYSTEM_TIME_REALTIME);
+        nsecs_t toReal = real > ts ? real - ts : ts - real;
+        nsecs_t toMono = now > ts ? now - ts : ts - now;
+        if (toReal < toMono)
+            ts += now - real;
+    }
+
+    info->timestamp = ts;
+    info->dqTime = now;
+    info->sequence = buf->sequence;
+    info->flags = buf->flags;
+}
+
+int SecV4L2Adapter::dqBuf(struct SecV4L2FrameInfo* info)
 {
     struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[MAX_CAM_PLANES];
     int ret;
 
     if (_fd == 0) {
@@ -615,13 +1122,16 @@ int SecV4L2Adapter::dqBuf(void)
         return -1;
     }
 
-    v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    v4l2_buf.memory = V4L2_MEMORY_MMAP;
+    _initBuf(&v4l2_buf, planes, _memory, 0);
 
-    ret = ioctl(_fd, VIDIOC_DQBUF, &v4l2_buf);
+    ret = _ioctl(VIDIOC_DQBUF, &v4l2_buf);
     if (ret < 0) {
-        LOGE("%s: VIDIOC_DQBUF failed\n", __func__);
-        return ret;
+        // nothing captured yet. expected, callers wait and retry
+        if (errno == EAGAIN)
+            return -EAGAIN;
+
+        LOGE("%s: VIDIOC_DQBUF failed (%s)\n", __func__, strerror(errno));
+        return -1;
     }
 
     if (v4l2_buf.index > (_bufCnt - 1)) {
@@ -629,9 +1139,37 @@ int SecV4L2Adapter::dqBuf(void)
         return -1;
     }
 
+    android_atomic_dec(&_queuedCnt);
+    _countFrame(v4l2_buf.sequence);
+
+    if (info)
+        _getFrameInfo(&v4l2_buf, info);
+
     return v4l2_buf.index;
 }
 
+// A gap since the last frame was lost before it could be dequeued. If
+// the driver had no buffer left after that frame, consumers were
+// holding them all and the gap is theirs, else the driver's.
+void SecV4L2Adapter::_countFrame(unsigned int sequence)
+{
+    Mutex::Autolock lock(_dropLock);
+    int gap = (int)(sequence - _lastSeq) - 1;
+    if (_seqValid && gap > 0) {
+        LOGV("%s: %d frames lost before #%u%s", __func__, gap, sequence,
+             _starved ? ", no buffer queued" : "");
+        if (_starved)
+            _drops.heldDrops += gap;
+        else
+            _drops.driverDrops += gap;
+    }
+
+    _seqValid = true;
+    _lastSeq = sequence;
+    _starved = android_atomic_acquire_load(&_queuedCnt) <= 0;
+    _drops.frames++;
+}
+
 int SecV4L2Adapter::qAllBufs(void)
 {
     int err;
@@ -644,41 +1182,279 @@ int SecV4L2Adapter::qAllBufs(void)
     return 0;
 }
 
-int SecV4L2Adapter::blk_dqbuf(void)
+int SecV4L2Adapter::setDeliveryPolicy(int policy, int maxAgeMs)
 {
-    struct v4l2_buffer v4l2_buf;
+    if (policy < 0 || policy >= DELIVER_POLICY_MAX) {
+        LOGE("%s: invalid policy, %d!", __func__, policy);
+        return -1;
+    }
+
+    LOGV("%s: policy = %d, maxAge = %dms", __func__, policy, maxAgeMs);
+    _policy = policy;
+    _maxAge = ms2ns(maxAgeMs);
+
+    return 0;
+}
+
+unsigned int SecV4L2Adapter::getSkippedFrames(int policy)
+{
+    if (policy < 0 || policy >= DELIVER_POLICY_MAX)
+        return 0;
+
+    return _skippedFrames[policy];
+}
+
+// Dequeue one frame according to the delivery policy. Waits for a frame
+// if none is ready, returning the error of waitFrame() if none comes.
+// Frames skipped by the policy go straight back to the driver; the
+// newest frame is always delivered, however old it is.
+int SecV4L2Adapter::dqFrame(struct SecV4L2FrameInfo* info)
+{
+    struct SecV4L2FrameInfo frame;
     int index;
-    int ret = 0;
 
     if (_fd == 0) {
         LOGE("%s: camera not opened!", __func__);
         return -1;
     }
 
-    v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    v4l2_buf.memory = V4L2_MEMORY_MMAP;
+    index = dqBuf(&frame);
+    while (index == -EAGAIN) {
+        int err = waitFrame();
+        if (err)
+            return err;
+
+        index = dqBuf(&frame);
+    }
+
+    if (index < 0)
+        return index;
 
-    ret = ioctl(_fd, VIDIOC_DQBUF, &v4l2_buf);
-    if (ret < 0) {
-        // LOGV("VIDIOC_DQBUF first is empty") ;
-        waitFrame();
-        return dqBuf();
-    } else {
-        index = v4l2_buf.index;
-        while (ret == 0) {
-            ret = ioctl(_fd, VIDIOC_DQBUF, &v4l2_buf);
-            if (ret == 0) {
-                LOGV("VIDIOC_DQBUF is not still empty %d", v4l2_buf.index);
-                qBuf(index);
-                index = v4l2_buf.index;
-            } else {
-                LOGV("VIDIOC_DQBUF is empty now %d ",
-                     index);
-                return index;
-            }
+    while (_policy != DELIVER_FIFO) {
+        if (_policy == DELIVER_FIFO_MAX_AGE &&
+            systemTime(SYSTEM_TIME_MONOTONIC) - frame.timestamp <= _maxAge)
+            break;
+
+        // -EAGAIN once the queue is drained
+        struct SecV4L2FrameInfo next;
+        int nextIndex = dqBuf(&next);
+        if (nextIndex < 0)
+            break;
+
+        LOGV("%s: skipping frame #%u in buffer-%d", __func__,
+             frame.sequence, index);
+        qBuf(index);
+        _skippedFrames[_policy]++;
+        _dropLock.lock();
+        _drops.skipped++;
+        _dropLock.unlock();
+
+        index = nextIndex;
+        frame = next;
+    }
+
+    if (info)
+        *info = frame;
+
+    return index;
+}
+
+void SecV4L2Adapter::getDropStats(struct SecV4L2DropStats* stats)
+{
+    Mutex::Autolock lock(_dropLock);
+    *stats = _drops;
+}
+
+// Read the driver's frame counters and add a sample to the rolling
+// window. Meant to be called periodically, away from the frame path;
+// the counters are read before _dropLock is taken, so dqBuf() never
+// waits on the driver here. Returns the frames lost by the driver or the consumers over the
+// window, per mille of all the sensor produced.
+unsigned int SecV4L2Adapter::sampleDrops(void)
+{
+    if (_fd == 0)
+        return 0;
+
+    bool hasFrames = false, hasLost = false;
+    unsigned int driverFrames = 0, driverLost = 0;
+    if (_hasDropCtrls) {
+        struct v4l2_control ctrl;
+
+        ctrl.id = V4L2_CID_IS_GET_FRAME_NUMBER;
+        ctrl.value = 0;
+        if (_ioctl(VIDIOC_G_CTRL, &ctrl) < 0) {
+            LOGV("%s: no frame counters in the driver", __func__);
+            _hasDropCtrls = false;
+        } else {
+            hasFrames = true;
+            driverFrames = ctrl.value;
+
+            ctrl.id = V4L2_CID_IS_GET_LOSTED_FRAME_NUMBER;
+            ctrl.value = 0;
+            hasLost = _ioctl(VIDIOC_G_CTRL, &ctrl) == 0;
+            driverLost = ctrl.value;
         }
     }
-    return v4l2_buf.index;
+
+    Mutex::Autolock lock(_dropLock);
+    if (hasFrames)
+        _drops.driverFrames = driverFrames;
+    if (hasLost)
+        _drops.driverLost = driverLost;
+
+    struct SecV4L2DropStats now = _drops;
+    const struct SecV4L2DropStats* oldest = &now;
+    if (_dropWindowCnt == DROP_WINDOW)
+        oldest = &_dropWindow[_dropWindowIdx];
+    else if (_dropWindowCnt)
+        oldest = &_dropWindow[0];
+
+    unsigned int driver = now.driverDrops - oldest->driverDrops;
+    unsigned int held = now.heldDrops - oldest->heldDrops;
+    unsigned int skipped = now.skipped - oldest->skipped;
+    unsigned int total = now.frames - oldest->frames + driver + held;
+
+    memset(&_dropRates, 0, sizeof(_dropRates));
+    if (total) {
+        _dropRates.frames = total;
+        _dropRates.driverDrops = driver * 1000 / total;
+        _dropRates.heldDrops = held * 1000 / total;
+        _dropRates.skipped = skipped * 1000 / total;
+    }
+
+    _dropWindow[_dropWindowIdx] = now;
+    _dropWindowIdx = (_dropWindowIdx + 1) % DROP_WINDOW;
+    if (_dropWindowCnt < DROP_WINDOW)
+        _dropWindowCnt++;
+
+    return _dropRates.driverDrops + _dropRates.heldDrops;
+}
+
+// Every ioctl to the node goes through here to be counted and timed.
+// An empty DQBUF isn't an error for a non-blocking node.
+int SecV4L2Adapter::_ioctl(unsigned long request, void* arg)
+{
+    nsecs_t start = systemTime();
+    int ret = _dev->ioctl(request, arg);
+    int err = errno;
+
+    _stats.add(SecV4L2Stats::opOf(request), systemTime() - start,
+               ret < 0 && err != EAGAIN);
+
+    errno = err;
+    return ret;
+}
+
+void SecV4L2Adapter::dump(String8& result, const char* name)
+{
+    result.appendFormat("  %s: fd=%d buffers=%u planes=%u size=%u "
+                        "policy=%d\n",
+                        name, _fd, _bufCnt, _planeCnt, _bufSize, _policy);
+    result.appendFormat("  %s skipped: latest=%u fifo=%u fifo-max-age=%u\n",
+                        name,
+                        _skippedFrames[DELIVER_LATEST],
+                        _skippedFrames[DELIVER_FIFO],
+                        _skippedFrames[DELIVER_FIFO_MAX_AGE]);
+    _caps.dump(result, name);
+    result.appendFormat("  %s shadow: ctrl hits=%u misses=%u "
+                        "parm hits=%u misses=%u\n",
+                        name, _ctrlHits, _ctrlMisses,
+                        _parmHits, _parmMisses);
+    _dropLock.lock();
+    struct SecV4L2DropStats drops = _drops;
+    struct SecV4L2DropStats rates = _dropRates;
+    _dropLock.unlock();
+    result.appendFormat("  %s drops: frames=%u driver=%u held=%u skipped=%u "
+                        "driver counters=%u/%u lost\n",
+                        name, drops.frames, drops.driverDrops,
+                        drops.heldDrops, drops.skipped,
+                        drops.driverLost, drops.driverFrames);
+    result.appendFormat("  %s drop rates over %u frames: driver=%u.%u%% "
+                        "held=%u.%u%% skipped=%u.%u%%\n",
+                        name, rates.frames,
+                        rates.driverDrops / 10, rates.driverDrops % 10,
+                        rates.heldDrops / 10, rates.heldDrops % 10,
+                        rates.skipped / 10, rates.skipped % 10);
+    _stats.dump(result, name);
+}
+
+// Controls that describe sensor state rather than trigger something.
+// Only these are shadowed; each maps to its field in sec_cam_parm.
+static const struct {
+    int id;
+    size_t offset;
+} _shadowCtrls[] = {
+    { V4L2_CID_CAMERA_CONTRAST,      offsetof(struct sec_cam_parm, contrast) },
+    { V4L2_CID_CAMERA_EFFECT,        offsetof(struct sec_cam_parm, effects) },
+    { V4L2_CID_CAMERA_BRIGHTNESS,    offsetof(struct sec_cam_parm, brightness) },
+    { V4L2_CID_CAMERA_FLASH_MODE,    offsetof(struct sec_cam_parm, flash_mode) },
+    { V4L2_CID_CAMERA_FOCUS_MODE,    offsetof(struct sec_cam_parm, focus_mode) },
+    { V4L2_CID_CAMERA_ISO,           offsetof(struct sec_cam_parm, iso) },
+    { V4L2_CID_CAMERA_METERING,      offsetof(struct sec_cam_parm, metering) },
+    { V4L2_CID_CAMERA_SATURATION,    offsetof(struct sec_cam_parm, saturation) },
+    { V4L2_CID_CAMERA_SCENE_MODE,    offsetof(struct sec_cam_parm, scene_mode) },
+    { V4L2_CID_CAMERA_SHARPNESS,     offsetof(struct sec_cam_parm, sharpness) },
+    { V4L2_CID_CAMERA_WHITE_BALANCE, offsetof(struct sec_cam_parm, white_balance) },
+    { V4L2_CID_CAMERA_FRAME_RATE,    offsetof(struct sec_cam_parm, fps) },
+};
+
+#define NUM_SHADOW_CTRLS (sizeof(_shadowCtrls) / sizeof(_shadowCtrls[0]))
+
+static int _shadowIdx(int id)
+{
+    for (unsigned int i = 0; i < NUM_SHADOW_CTRLS; i++) {
+        if (_shadowCtrls[i].id == id)
+            return i;
+    }
+
+    return -1;
+}
+
+static int* _shadowField(struct sec_cam_parm* parm, int i)
+{
+    return (int*)((char*)parm + _shadowCtrls[i].offset);
+}
+
+bool SecV4L2Adapter::_isShadowHit(int id, int value)
+{
+    int i = _shadowIdx(id);
+    if (i < 0)
+        return false;
+
+    if ((_ctrlValid & (1 << i)) && *_shadowField(&_parmShadow, i) == value) {
+        _ctrlHits++;
+        return true;
+    }
+
+    _ctrlMisses++;
+    return false;
+}
+
+void SecV4L2Adapter::_updateShadow(int id, int value, bool ok)
+{
+    if (id == V4L2_CID_CAMERA_RESET) {
+        _invalidateShadow();
+        return;
+    }
+
+    int i = _shadowIdx(id);
+    if (i < 0)
+        return;
+
+    if (ok) {
+        *_shadowField(&_parmShadow, i) = value;
+        _ctrlValid |= 1 << i;
+    } else {
+        // the sensor may or may not have taken it
+        _ctrlValid &= ~(1 << i);
+        _parmValid = false;
+    }
+}
+
+void SecV4L2Adapter::_invalidateShadow(void)
+{
+    _ctrlValid = 0;
+    _parmValid = false;
 }
 
 int SecV4L2Adapter::getCtrl(int id)
@@ -691,18 +1467,35 @@ int SecV4L2Adapter::getCtrl(int id)
         return -1;
     }
 
+    int i = _shadowIdx(id);
+    if (i >= 0 && (_ctrlValid & (1 << i))) {
+        _ctrlHits++;
+        return *_shadowField(&_parmShadow, i);
+    }
+
     ctrl.id = id;
 
-    ret = ioctl(_fd, VIDIOC_G_CTRL, &ctrl);
+    ret = _ioctl(VIDIOC_G_CTRL, &ctrl);
     if (ret < 0) {
         LOGE("ERR(%s): VIDIOC_G_CTRL(id = 0x%x (%d)) failed, ret = %d\n", __func__, id, id - V4L2_CID_PRIVATE_BASE, ret);
         return ret;
     }
 
+    _updateShadow(id, ctrl.value, true);
+
     return ctrl.value;
 }
 
+// Writes of a shadowed control with the value it already has are skipped
 int SecV4L2Adapter::setCtrl(int id, int value)
+{
+    if (_isShadowHit(id, value))
+        return value;
+
+    return _setCtrl(id, value);
+}
+
+int SecV4L2Adapter::_setCtrl(int id, int value)
 {
     struct v4l2_control ctrl;
     int ret;
@@ -715,7 +1508,8 @@ int SecV4L2Adapter::setCtrl(int id, int value)
     ctrl.id = id;
     ctrl.value = value;
 
-    ret = ioctl(_fd, VIDIOC_S_CTRL, &ctrl);
+    ret = _ioctl(VIDIOC_S_CTRL, &ctrl);
+    _updateShadow(id, value, ret >= 0);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_CTRL(id = %#x (%d), value = %d) failed ret = %d\n", __func__, id, id - V4L2_CID_PRIVATE_BASE, value, ret);
         return ret;
@@ -724,6 +1518,99 @@ int SecV4L2Adapter::setCtrl(int id, int value)
     return ctrl.value;
 }
 
+// Collect the following addCtrl() calls instead of sending each one to the
+// sensor on its own. commitCtrls() then applies them in one transaction.
+int SecV4L2Adapter::beginCtrls(void)
+{
+    LOGW_IF(_pendingCtrlCnt, "%s: %u controls still pending!",
+            __func__, _pendingCtrlCnt);
+
+    _batchCtrls = true;
+    return 0;
+}
+
+int SecV4L2Adapter::addCtrl(int id, int value)
+{
+    if (!_batchCtrls)
+        return setCtrl(id, value);
+
+    if (_isShadowHit(id, value))
+        return value;
+
+    // a later value for the same control replaces the earlier one
+    for (unsigned int i = 0; i < _pendingCtrlCnt; i++) {
+        if (_pendingCtrls[i].id == (unsigned int)id) {
+            _pendingCtrls[i].value = value;
+            return value;
+        }
+    }
+
+    if (_pendingCtrlCnt == MAX_PENDING_CTRLS) {
+        int err = commitCtrls();
+        _batchCtrls = true;
+        if (err)
+            return err;
+    }
+
+    struct v4l2_ext_control* ctrl = &_pendingCtrls[_pendingCtrlCnt++];
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->id = id;
+    ctrl->value = value;
+
+    return value;
+}
+
+// Apply the collected controls with one VIDIOC_S_EXT_CTRLS. Drivers that
+// can't take them that way get one VIDIOC_S_CTRL per control instead.
+int SecV4L2Adapter::commitCtrls(void)
+{
+    int ret = 0;
+
+    _batchCtrls = false;
+    if (_pendingCtrlCnt == 0)
+        return 0;
+
+    if (_fd == 0) {
+        LOGE("%s: camera not opened!", __func__);
+        _pendingCtrlCnt = 0;
+        return -1;
+    }
+
+    if (_extCtrls) {
+        struct v4l2_ext_controls ctrls;
+        memset(&ctrls, 0, sizeof(ctrls));
+        // private controls belong to no class
+        ctrls.ctrl_class = 0;
+        ctrls.count = _pendingCtrlCnt;
+        ctrls.controls = _pendingCtrls;
+
+        ret = _ioctl(VIDIOC_S_EXT_CTRLS, &ctrls);
+        if (ret == 0) {
+            LOGV("%s: %u controls set", __func__, _pendingCtrlCnt);
+            for (unsigned int i = 0; i < _pendingCtrlCnt; i++)
+                _updateShadow(_pendingCtrls[i].id, _pendingCtrls[i].value,
+                              true);
+            _pendingCtrlCnt = 0;
+            return 0;
+        }
+
+        LOGW("%s: VIDIOC_S_EXT_CTRLS failed at %u of %u (%s). "
+             "setting them one by one", __func__, ctrls.error_idx,
+             _pendingCtrlCnt, strerror(errno));
+        if (errno == ENOTTY)
+            _extCtrls = false;
+    }
+
+    ret = 0;
+    for (unsigned int i = 0; i < _pendingCtrlCnt; i++) {
+        if (_setCtrl(_pendingCtrls[i].id, _pendingCtrls[i].value) < 0)
+            ret = -1;
+    }
+    _pendingCtrlCnt = 0;
+
+    return ret;
+}
+
 int SecV4L2Adapter::getParm(struct sec_cam_parm* parm)
 {
     struct v4l2_streamparm streamparm;
@@ -739,9 +1626,9 @@ int SecV4L2Adapter::getParm(struct sec_cam_parm* parm)
         return -1;
     }
 
-    streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    streamparm.type = _bufType;
 
-    ret = ioctl(_fd, VIDIOC_G_PARM, &streamparm);
+    ret = _ioctl(VIDIOC_G_PARM, &streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_G_PARM failed\n", __func__);
         return -1;
@@ -767,53 +1654,156 @@ int SecV4L2Adapter::setParm(const struct sec_cam_parm* parm)
         return -1;
     }
 
-    streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (_parmValid && !memcmp(&_parmShadow, parm, sizeof(_parmShadow))) {
+        _parmHits++;
+        return 0;
+    }
+    _parmMisses++;
+
+    streamparm.type = _bufType;
 
     memcpy(&streamparm.parm.raw_data, parm, sizeof(sec_cam_parm));
 
-    ret = ioctl(_fd, VIDIOC_S_PARM, &streamparm);
+    ret = _ioctl(VIDIOC_S_PARM, &streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_PARM failed\n", __func__);
+        _invalidateShadow();
         return ret;
     }
 
+    // the stream parameters carry every shadowed control as well
+    _parmShadow = *parm;
+    _parmValid = true;
+    _ctrlValid = (1 << NUM_SHADOW_CTRLS) - 1;
+
+    return 0;
+}
+
+// Ask the driver for the physical addresses of every buffer once, while
+// setting the buffer set up, rather than twice per frame.
+void SecV4L2Adapter::_resolveAddrs(void)
+{
+    if (isMplane() || _memory != V4L2_MEMORY_MMAP)
+        return;
+
+    for (unsigned int i = 0; i < _bufCnt; i++) {
+        unsigned int y, c;
+        if (_getPaddr(V4L2_CID_PADDR_Y, i, &y) < 0 ||
+            _getPaddr(V4L2_CID_PADDR_CBCR, i, &c) < 0) {
+            LOGW("%s: no address for buffer-%u", __func__, i);
+            continue;
+        }
+
+        _bufs[i].addrY = y;
+        _bufs[i].addrC = c;
+        _bufs[i].addrValid = true;
+    }
+}
+
+// The driver swaps the buffer index for its address. Addresses from 2GB
+// up come back negative as an int, so only the ioctl result tells
+// failure apart.
+int SecV4L2Adapter::_getPaddr(int id, unsigned int idx, unsigned int* addr)
+{
+    struct v4l2_control ctrl;
+
+    ctrl.id = id;
+    ctrl.value = idx;
+
+    int ret = _ioctl(VIDIOC_S_CTRL, &ctrl);
+    if (ret < 0)
+        return ret;
+
+    *addr = (unsigned int)ctrl.value;
     return 0;
 }
 
 int SecV4L2Adapter::getAddr(int idx, unsigned int* addrY, unsigned int* addrC)
 {
-    if (addrY) {
-        *addrY = setCtrl(V4L2_CID_PADDR_Y, idx);
+    if (idx < 0 || (unsigned int)idx >= _bufCnt) {
+        LOGE("%s: invalid index, %d!", __func__, idx);
+        return -1;
     }
-    if (addrC) {
-        *addrC = setCtrl(V4L2_CID_PADDR_CBCR, idx);
+
+    if (_bufs[idx].addrValid) {
+        if (addrY)
+            *addrY = _bufs[idx].addrY;
+        if (addrC)
+            *addrC = _bufs[idx].addrC;
+        return 0;
+    }
+
+    if (isMplane())
+        return -1;
+
+    if (addrY && _getPaddr(V4L2_CID_PADDR_Y, idx, addrY) < 0) {
+        LOGE("%s: no address for buffer-%d!", __func__, idx);
+        return -1;
+    }
+    if (addrC && _getPaddr(V4L2_CID_PADDR_CBCR, idx, addrC) < 0) {
+        LOGE("%s: no address for buffer-%d!", __func__, idx);
+        return -1;
     }
 
     return 0;
 }
 
+// 0 once a frame can be dequeued. -ETIMEDOUT if none came in time,
+// -ECANCELED after cancelWait(), or the errno of poll() negated.
 int SecV4L2Adapter::waitFrame(int timeout)
 {
+    struct pollfd fds[2];
     int ret;
 
+    fds[0] = _poll;
+    fds[1].fd = _cancelPipe[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
     /* 10 second delay is because sensor can take a long time
      * to do auto focus and capture in dark settings
      */
-    ret = poll(&_poll, 1, timeout);
+    nsecs_t start = systemTime();
+    ret = poll(fds, _cancelPipe[0] >= 0 ? 2 : 1, timeout);
+    _stats.add(SecV4L2Stats::OP_POLL, systemTime() - start, ret <= 0);
     if (ret < 0) {
-        LOGE("ERR(%s):poll error, revent = %d\n", __func__,
-             _poll.revents);
+        ret = -errno;
+        LOGE("ERR(%s):poll error (%s)\n", __func__, strerror(-ret));
         return ret;
     }
 
+    if (fds[1].revents & POLLIN) {
+        LOGV("%s: canceled", __func__);
+        return -ECANCELED;
+    }
+
     if (ret == 0) {
         LOGE("ERR(%s):No data in %d msecs..\n", __func__, timeout);
-        return ret;
+        return -ETIMEDOUT;
     }
 
     return 0;
 }
 
+// Wake any thread in waitFrame() and keep later waits from blocking, so
+// stopping doesn't sit out a poll timeout. Undone by startStream(true).
+void SecV4L2Adapter::cancelWait(void)
+{
+    if (_cancelPipe[1] >= 0)
+        write(_cancelPipe[1], "c", 1);
+}
+
+void SecV4L2Adapter::_clearCancel(void)
+{
+    char buf[8];
+
+    if (_cancelPipe[0] < 0)
+        return;
+
+    while (read(_cancelPipe[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
 int SecV4L2Adapter::getFd(void)
 {
     return _fd;
@@ -824,4 +1814,9 @@ int SecV4L2Adapter::getChIdx(void)
     return _chIdx;
 }
 
+SecV4L2Caps* SecV4L2Adapter::getCaps(void)
+{
+    return &_caps;
+}
+
 };
@@ -19,35 +19,97 @@
 
 #include <sys/poll.h>
 #include <linux/videodev2.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
 #include "videodev2_samsung.h"
-
-#define MAX_CAM_BUFFERS         (8)
+#include "SecV4L2Caps.h"
+#include "SecV4L2Device.h"
+#include "SecV4L2Stats.h"
+
+// bounds of a buffer set. the count itself is picked per stream
+#define MIN_CAM_BUFFERS         (3)
+#define MAX_CAM_BUFFERS         (32)
+#define MAX_CAM_PLANES          (3)
+#define MAX_PENDING_CTRLS       (16)
+// samples drop rates are computed over
+#define DROP_WINDOW             (8)
 
 namespace android {
 
+// What the driver told about a dequeued frame
+struct SecV4L2FrameInfo {
+    nsecs_t timestamp;      // capture time in SYSTEM_TIME_MONOTONIC
+    nsecs_t dqTime;         // when it was dequeued
+    unsigned int sequence;
+    unsigned int flags;
+};
+
+// Frames of a stream that never reached a consumer, by where they went.
+// Gaps in the frame sequence are lost on the driver side; they are put
+// on the consumers when those held every buffer at the time.
+struct SecV4L2DropStats {
+    unsigned int frames;        // dequeued
+    unsigned int driverDrops;   // gaps while the driver had buffers
+    unsigned int heldDrops;     // gaps while consumers held every buffer
+    unsigned int skipped;       // requeued unseen by dqFrame()
+    unsigned int driverFrames;  // counters of the driver, if it has them
+    unsigned int driverLost;
+};
+
 class SecV4L2Adapter {
 public:
+    // how dqFrame() picks a frame when more than one is waiting
+    enum deliveryPolicy {
+        DELIVER_LATEST = 0,     // newest frame only, older ones are requeued
+        DELIVER_FIFO,           // every frame, in capture order
+        DELIVER_FIFO_MAX_AGE,   // in order, but skip frames older than a bound
+        DELIVER_POLICY_MAX
+    };
+
     SecV4L2Adapter(const char* path, int ch);
     ~SecV4L2Adapter();
 
     int getFd(void);
     int getChIdx(void);
+    SecV4L2Caps* getCaps(void);
 
-    int setupBufs(int w, int h, unsigned int fmt, unsigned int n, int flag = 0);
+    int setupBufs(int w, int h, unsigned int fmt, unsigned int n, int flag = 0,
+                  int memory = V4L2_MEMORY_MMAP);
+    int setUserBuf(int idx, void* start, size_t size);
+    int getMemory(void);
     int mapBuf(int idx);
     int mapBufInfo(int idx, void** start, size_t* size);
+    int mapPlaneInfo(int idx, int plane, void** start, size_t* size);
+    int getPlaneCnt(void);
+    bool isMplane(void);
+    int exportBufs(void);
+    int getBufFd(int idx);
+    int getPlaneFd(int idx, int plane);
     int closeBufs(void);
+    int flushBufs(void);
     int startStream(bool on);
     int qBuf(unsigned int idx);
-    int dqBuf(void);
+    int dqBuf(struct SecV4L2FrameInfo* info = NULL);
     int qAllBufs(void);
-    int blk_dqbuf(void);
+    int setDeliveryPolicy(int policy, int maxAgeMs = 0);
+    int dqFrame(struct SecV4L2FrameInfo* info = NULL);
+    unsigned int getSkippedFrames(int policy);
+    void getDropStats(struct SecV4L2DropStats* stats);
+    unsigned int sampleDrops(void);
+    void dump(String8& result, const char* name);
     int getCtrl(int id);
     int setCtrl(int id, int value);
+    int beginCtrls(void);
+    int addCtrl(int id, int value);
+    int commitCtrls(void);
     int getParm(struct sec_cam_parm* parm);
     int setParm(const struct sec_cam_parm* parm);
     int waitFrame(int timeout = 10000);
+    void cancelWait(void);
 
+    // physical addresses of the Y and CbCr planes. -1 on multi-planar
+    // drivers, which have no address ctrls; see getPlaneFd() there.
     int getAddr(int idx, unsigned int* addrY, unsigned int* addrC);
 
     int enumSceneMode(const char* strScene);
@@ -60,22 +122,117 @@ public:
     int nPixfmt(const char* strPixfmt);
 
     unsigned int frameSize(void);
+    unsigned int getBufCnt(void);
+    int getStride(void);
 
 private:
     int	_fd;
     int _chIdx;
+    SecV4L2Device* _dev;
+    unsigned int _bufType;
     struct pollfd _poll;
+    // written by cancelWait() to break a waitFrame() out of poll()
+    int _cancelPipe[2];
+    SecV4L2Caps _caps;
+    SecV4L2Stats _stats;
+
+    // key of the live buffer set. kept across closeBufs() so that
+    // setupBufs() with the same key reuses allocations and mappings
+    struct bufSetKey {
+        int w;
+        int h;
+        unsigned int fmt;
+        unsigned int n;
+        int flag;
+        int memory;
+    };
+    struct bufSetKey _bufSetKey;
 
     unsigned int _bufCnt;
     size_t _bufSize;
-    void* _bufMapStart[MAX_CAM_BUFFERS];
-
+    size_t _imageSize;
+    int _stride;            // bytes per line of the first plane, 0 if unknown
+    int _memory;
+
+    int _policy;
+    nsecs_t _maxAge;
+    unsigned int _skippedFrames[DELIVER_POLICY_MAX];
+
+    // drop accounting. _queuedCnt is how many buffers the driver has,
+    // atomic as buffers may be queued on another thread than dqBuf()'s
+    volatile int32_t _queuedCnt;
+    bool _seqValid;
+    unsigned int _lastSeq;
+    bool _starved;
+    bool _hasDropCtrls;
+    // _drops is counted on the frame path and sampled on another thread;
+    // _dropLock covers it and the rolling window below
+    Mutex _dropLock;
+    struct SecV4L2DropStats _drops;
+    // samples of _drops for the rolling rates, oldest first once full
+    struct SecV4L2DropStats _dropWindow[DROP_WINDOW];
+    unsigned int _dropWindowCnt;
+    unsigned int _dropWindowIdx;
+    struct SecV4L2DropStats _dropRates;     // per mille of all frames
+
+    // one entry per plane; single-planar buffers only use the first
+    struct camBuf {
+        void* start[MAX_CAM_PLANES];
+        int fd[MAX_CAM_PLANES];
+        // physical addresses, fixed for the life of the buffer set
+        bool addrValid;
+        unsigned int addrY;
+        unsigned int addrC;
+    };
+    struct camBuf* _bufs;
+    unsigned int _planeCnt;
+    size_t _planeSize[MAX_CAM_PLANES];
+
+    // controls collected by addCtrl() between beginCtrls() and commitCtrls()
+    bool _batchCtrls;
+    bool _extCtrls;
+    unsigned int _pendingCtrlCnt;
+    struct v4l2_ext_control _pendingCtrls[MAX_PENDING_CTRLS];
+
+    // last values known to be in the sensor. controls that are also part
+    // of sec_cam_parm are shadowed in the matching field of _parmShadow;
+    // _ctrlValid has one bit per such control.
+    struct sec_cam_parm _parmShadow;
+    bool _parmValid;
+    unsigned int _ctrlValid;
+    unsigned int _ctrlHits;
+    unsigned int _ctrlMisses;
+    unsigned int _parmHits;
+    unsigned int _parmMisses;
+
+    int _ioctl(unsigned long request, void* arg);
+    void _countFrame(unsigned int sequence);
     int _openCamera(const char* path);
     int _setInputChann(int ch);
 
+    bool _hasFmt(unsigned int fmt);
     int _setFmt(int w, int h, unsigned int fmt, int flag);
-    int _reqBufs(int n);
+    int _setFmtMplane(int w, int h, unsigned int fmt);
+    int _reqBufs(int n, int memory);
+    int _allocBufTable(unsigned int n);
+    void _freeBufTable(void);
+    void _initBuf(struct v4l2_buffer* buf, struct v4l2_plane* planes,
+                  int memory, int idx);
     int _queryBuf(int idx, int* length, int* offset);
+    bool _isBufSetCached(const struct bufSetKey* key);
+    void _clearCancel(void);
+    void _getFrameInfo(const struct v4l2_buffer* buf,
+                       struct SecV4L2FrameInfo* info);
+    void _unmapBuf(int idx);
+    void _resolveAddrs(void);
+    int _getPaddr(int id, unsigned int idx, unsigned int* addr);
+    int _exportBuf(int idx, int plane);
+    void _closeBufFds(void);
+
+    int _setCtrl(int id, int value);
+    bool _isShadowHit(int id, int value);
+    void _updateShadow(int id, int value, bool ok);
+    void _invalidateShadow(void);
 };
 
 };
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecV4L2Caps"
+#include <utils/Log.h>
+#include "CameraLog.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include "SecV4L2Caps.h"
+
+#define CAPS_MAGIC      v4l2_fourcc('S', 'C', 'A', 'P')
+#define CAPS_VERSION    (1)
+
+namespace android {
+
+SecV4L2Caps::SecV4L2Caps() :
+    _fmtCnt(0),
+    _sizeCnt(0),
+    _fromCache(false)
+{
+    memset(&_key, 0, sizeof(_key));
+    memset(_fmts, 0, sizeof(_fmts));
+    memset(_sizes, 0, sizeof(_sizes));
+}
+
+// Fill the table for the current input of dev, from the cache file if it
+// was written by the same driver, by asking the driver otherwise.
+int SecV4L2Caps::load(SecV4L2Device* dev, unsigned int bufType, int ch)
+{
+    LOG_CAMERA_FUNC_ENTER;
+    struct v4l2_capability cap;
+
+    memset(&cap, 0, sizeof(cap));
+    if (dev->ioctl(VIDIOC_QUERYCAP, &cap) < 0) {
+        LOGE("%s: VIDIOC_QUERYCAP failed!", __func__);
+        return -1;
+    }
+
+    memset(&_key, 0, sizeof(_key));
+    _key.magic = CAPS_MAGIC;
+    _key.version = CAPS_VERSION;
+    strncpy(_key.driver, (const char*)cap.driver, sizeof(_key.driver) - 1);
+    strncpy(_key.card, (const char*)cap.card, sizeof(_key.card) - 1);
+    strncpy(_key.bus, (const char*)cap.bus_info, sizeof(_key.bus) - 1);
+    _key.kversion = cap.version;
+    _key.bufType = bufType;
+    _key.ch = ch;
+
+    char path[256];
+    _getCachePath(path, sizeof(path));
+
+    if (_readCache(path) == 0) {
+        LOGI("%s: %u formats, %u sizes from %s", __func__,
+             _fmtCnt, _sizeCnt, path);
+        _fromCache = true;
+        return 0;
+    }
+
+    _enumerate(dev);
+    LOGI("%s: %u formats, %u sizes enumerated", __func__, _fmtCnt, _sizeCnt);
+    _fromCache = false;
+
+    _writeCache(path);
+
+    return 0;
+}
+
+void SecV4L2Caps::_enumerate(SecV4L2Device* dev)
+{
+    struct v4l2_fmtdesc fmtdesc;
+
+    _fmtCnt = 0;
+    _sizeCnt = 0;
+
+    memset(&fmtdesc, 0, sizeof(fmtdesc));
+    fmtdesc.type = _key.bufType;
+
+    for (fmtdesc.index = 0; _fmtCnt < MAX_CAPS_FMTS; fmtdesc.index++) {
+        if (dev->ioctl(VIDIOC_ENUM_FMT, &fmtdesc) < 0)
+            break;
+
+        LOGV("pixel format[%d]: %s (%s)", fmtdesc.index,
+             getStrFourCC(fmtdesc.pixelformat), fmtdesc.description);
+        _fmts[_fmtCnt++] = fmtdesc.pixelformat;
+        _enumSizes(dev, fmtdesc.pixelformat);
+    }
+}
+
+void SecV4L2Caps::_enumSizes(SecV4L2Device* dev, unsigned int fmt)
+{
+    struct v4l2_frmsizeenum frmsize;
+
+    memset(&frmsize, 0, sizeof(frmsize));
+    frmsize.pixel_format = fmt;
+
+    for (frmsize.index = 0; ; frmsize.index++) {
+        if (dev->ioctl(VIDIOC_ENUM_FRAMESIZES, &frmsize) < 0)
+            break;
+
+        if (frmsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+            _addSize(fmt, frmsize.discrete.width, frmsize.discrete.height);
+        } else {
+            // stepwise or continuous. only the bounds are worth listing
+            _addSize(fmt, frmsize.stepwise.max_width,
+                     frmsize.stepwise.max_height);
+            _addSize(fmt, frmsize.stepwise.min_width,
+                     frmsize.stepwise.min_height);
+            break;
+        }
+    }
+
+    for (unsigned int i = 0; i < _sizeCnt; i++) {
+        if (_sizes[i].fmt == fmt)
+            _enumFrameRates(dev, &_sizes[i]);
+    }
+}
+
+void SecV4L2Caps::_addSize(unsigned int fmt, int w, int h)
+{
+    if (_sizeCnt == MAX_CAPS_SIZES) {
+        LOGW("%s: too many frame sizes. %dx%d(%s) dropped", __func__,
+             w, h, getStrFourCC(fmt));
+        return;
+    }
+
+    if (hasSize(fmt, w, h))
+        return;
+
+    struct sizeCap* cap = &_sizes[_sizeCnt++];
+    memset(cap, 0, sizeof(*cap));
+    cap->fmt = fmt;
+    cap->w = w;
+    cap->h = h;
+}
+
+void SecV4L2Caps::_enumFrameRates(SecV4L2Device* dev, struct sizeCap* cap)
+{
+    struct v4l2_frmivalenum frmival;
+
+    memset(&frmival, 0, sizeof(frmival));
+    frmival.pixel_format = cap->fmt;
+    frmival.width = cap->w;
+    frmival.height = cap->h;
+
+    // a stepwise range takes two entries
+    cap->fpsCnt = 0;
+    for (frmival.index = 0; cap->fpsCnt < MAX_CAPS_FPS - 1; frmival.index++) {
+        if (dev->ioctl(VIDIOC_ENUM_FRAMEINTERVALS, &frmival) < 0)
+            break;
+
+        if (frmival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+            if (frmival.discrete.numerator)
+                cap->fps[cap->fpsCnt++] = frmival.discrete.denominator /
+                                          frmival.discrete.numerator;
+        } else {
+            // the shortest interval is the highest rate
+            if (frmival.stepwise.min.numerator)
+                cap->fps[cap->fpsCnt++] = frmival.stepwise.min.denominator /
+                                          frmival.stepwise.min.numerator;
+            if (frmival.stepwise.max.numerator)
+                cap->fps[cap->fpsCnt++] = frmival.stepwise.max.denominator /
+                                          frmival.stepwise.max.numerator;
+            break;
+        }
+    }
+}
+
+bool SecV4L2Caps::hasFmt(unsigned int fmt)
+{
+    for (unsigned int i = 0; i < _fmtCnt; i++) {
+        if (_fmts[i] == fmt)
+            return true;
+    }
+
+    return false;
+}
+
+bool SecV4L2Caps::hasSize(unsigned int fmt, int w, int h)
+{
+    for (unsigned int i = 0; i < _sizeCnt; i++) {
+        if (_sizes[i].fmt == fmt && _sizes[i].w == w && _sizes[i].h == h)
+            return true;
+    }
+
+    return false;
+}
+
+// Frame sizes of fmt as a parameter value list, largest first.
+// Returns -1 if the driver didn't tell any.
+int SecV4L2Caps::getSizes(unsigned int fmt, String8& values)
+{
+    const struct sizeCap* sorted[MAX_CAPS_SIZES];
+    unsigned int n = 0;
+
+    for (unsigned int i = 0; i < _sizeCnt; i++) {
+        if (_sizes[i].fmt != fmt)
+            continue;
+
+        const struct sizeCap* cap = &_sizes[i];
+        unsigned int j = n++;
+        while (j > 0 && sorted[j - 1]->w * sorted[j - 1]->h < cap->w * cap->h) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = cap;
+    }
+
+    if (n == 0)
+        return -1;
+
+    values.clear();
+    for (unsigned int i = 0; i < n; i++) {
+        values.appendFormat("%s%dx%d", i ? "," : "",
+                            sorted[i]->w, sorted[i]->h);
+    }
+
+    return 0;
+}
+
+// Frame rates any size of fmt can run at, highest first.
+// Returns -1 if the driver didn't tell any.
+int SecV4L2Caps::getFrameRates(unsigned int fmt, String8& values)
+{
+    int rates[MAX_CAPS_FPS * 2];
+    unsigned int n = 0;
+
+    for (unsigned int i = 0; i < _sizeCnt; i++) {
+        if (_sizes[i].fmt != fmt)
+            continue;
+
+        for (unsigned int f = 0; f < _sizes[i].fpsCnt; f++) {
+            int fps = _sizes[i].fps[f];
+            unsigned int j;
+            for (j = 0; j < n && rates[j] > fps; j++)
+                ;
+            if ((j < n && rates[j] == fps) || n == MAX_CAPS_FPS * 2)
+                continue;
+
+            memmove(&rates[j + 1], &rates[j], sizeof(int) * (n - j));
+            rates[j] = fps;
+            n++;
+        }
+    }
+
+    if (n == 0)
+        return -1;
+
+    values.clear();
+    for (unsigned int i = 0; i < n; i++)
+        values.appendFormat("%s%d", i ? "," : "", rates[i]);
+
+    return 0;
+}
+
+void SecV4L2Caps::dump(String8& result, const char* name)
+{
+    result.appendFormat("  %s caps: %s/%s formats=%u sizes=%u%s\n",
+                        name, _key.driver, _key.card, _fmtCnt, _sizeCnt,
+                        _fromCache ? " (cached)" : "");
+}
+
+void SecV4L2Caps::_getCachePath(char* path, size_t len)
+{
+    char card[sizeof(_key.card)];
+
+    // card names come with spaces and slashes
+    for (unsigned int i = 0; i < sizeof(card); i++) {
+        char c = _key.card[i];
+        card[i] = (c == 0 || isalnum(c)) ? c : '_';
+    }
+    card[sizeof(card) - 1] = 0;
+
+    snprintf(path, len, "%s/%s-%s-%d.caps", CAPS_CACHE_DIR,
+             _key.driver, card, _key.ch);
+}
+
+int SecV4L2Caps::_readCache(const char* path)
+{
+    struct capsKey key;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    int ret = -1;
+    if (read(fd, &key, sizeof(key)) != sizeof(key) ||
+        memcmp(&key, &_key, sizeof(key))) {
+        LOGI("%s: %s is stale", __func__, path);
+        goto out;
+    }
+
+    if (read(fd, &_fmtCnt, sizeof(_fmtCnt)) != sizeof(_fmtCnt) ||
+        _fmtCnt > MAX_CAPS_FMTS ||
+        read(fd, _fmts, sizeof(_fmts)) != sizeof(_fmts) ||
+        read(fd, &_sizeCnt, sizeof(_sizeCnt)) != sizeof(_sizeCnt) ||
+        _sizeCnt > MAX_CAPS_SIZES ||
+        read(fd, _sizes, sizeof(_sizes)) != sizeof(_sizes)) {
+        LOGW("%s: %s is broken", __func__, path);
+        _fmtCnt = 0;
+        _sizeCnt = 0;
+        goto out;
+    }
+
+    ret = 0;
+out:
+    close(fd);
+    return ret;
+}
+
+int SecV4L2Caps::_writeCache(const char* path)
+{
+    char tmpPath[256];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    if (mkdir(CAPS_CACHE_DIR, 0770) < 0 && errno != EEXIST) {
+        LOGW("%s: can't create %s (%s)", __func__, CAPS_CACHE_DIR,
+             strerror(errno));
+        return -1;
+    }
+
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd < 0) {
+        LOGW("%s: can't open %s (%s)", __func__, tmpPath, strerror(errno));
+        return -1;
+    }
+
+    bool ok = write(fd, &_key, sizeof(_key)) == sizeof(_key) &&
+              write(fd, &_fmtCnt, sizeof(_fmtCnt)) == sizeof(_fmtCnt) &&
+              write(fd, _fmts, sizeof(_fmts)) == sizeof(_fmts) &&
+              write(fd, &_sizeCnt, sizeof(_sizeCnt)) == sizeof(_sizeCnt) &&
+              write(fd, _sizes, sizeof(_sizes)) == sizeof(_sizes);
+    close(fd);
+
+    // readers only ever see a complete file
+    if (!ok || rename(tmpPath, path) < 0) {
+        LOGW("%s: failed to write %s", __func__, path);
+        unlink(tmpPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+};
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_SEC_V4L2_CAPS_H__
+#define __ANDROID_SEC_V4L2_CAPS_H__
+
+#include <linux/videodev2.h>
+#include <utils/String8.h>
+#include "SecV4L2Device.h"
+
+#define MAX_CAPS_FMTS           (16)
+#define MAX_CAPS_SIZES          (64)
+#define MAX_CAPS_FPS            (8)
+
+#define CAPS_CACHE_DIR          "/data/misc/camera"
+
+namespace android {
+
+// Formats, frame sizes and frame rates of one video node input. Built by
+// enumerating the driver once, then kept on disk keyed by the driver
+// identity so that later opens don't enumerate again.
+class SecV4L2Caps {
+public:
+    SecV4L2Caps();
+
+    int load(SecV4L2Device* dev, unsigned int bufType, int ch);
+
+    bool hasFmt(unsigned int fmt);
+    bool hasSize(unsigned int fmt, int w, int h);
+    int getSizes(unsigned int fmt, String8& values);
+    int getFrameRates(unsigned int fmt, String8& values);
+    void dump(String8& result, const char* name);
+
+private:
+    // identifies the driver a cache file was built from
+    struct capsKey {
+        unsigned int magic;
+        unsigned int version;
+        char driver[16];
+        char card[32];
+        char bus[32];
+        unsigned int kversion;
+        unsigned int bufType;
+        int ch;
+    };
+    struct capsKey _key;
+
+    struct sizeCap {
+        unsigned int fmt;
+        int w;
+        int h;
+        unsigned int fpsCnt;
+        int fps[MAX_CAPS_FPS];
+    };
+
+    unsigned int _fmtCnt;
+    unsigned int _fmts[MAX_CAPS_FMTS];
+    unsigned int _sizeCnt;
+    struct sizeCap _sizes[MAX_CAPS_SIZES];
+    bool _fromCache;
+
+    void _enumerate(SecV4L2Device* dev);
+    void _enumSizes(SecV4L2Device* dev, unsigned int fmt);
+    void _enumFrameRates(SecV4L2Device* dev, struct sizeCap* cap);
+    void _addSize(unsigned int fmt, int w, int h);
+    void _getCachePath(char* path, size_t len);
+    int _readCache(const char* path);
+    int _writeCache(const char* path);
+};
+
+};
+#endif
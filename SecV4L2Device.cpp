@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecV4L2Device"
+#include <utils/Log.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <cutils/properties.h>
+
+#include "SecV4L2Device.h"
+#include "SecV4L2FakeDevice.h"
+
+namespace android {
+
+SecV4L2Device* SecV4L2Device::create(void)
+{
+    char backend[PROPERTY_VALUE_MAX];
+    property_get(CAMERA_BACKEND_PROP, backend, CAMERA_BACKEND_DEF);
+
+    if (!strcmp(backend, "fake")) {
+        LOGI("%s: using synthetic sensor", __func__);
+        return new SecV4L2FakeDevice();
+    }
+
+    return new SecV4L2KernelDevice();
+}
+
+SecV4L2KernelDevice::SecV4L2KernelDevice() :
+    _fd(-1)
+{
+}
+
+SecV4L2KernelDevice::~SecV4L2KernelDevice()
+{
+    close();
+}
+
+int SecV4L2KernelDevice::open(const char* path)
+{
+    _fd = ::open(path, O_RDWR | O_NONBLOCK);
+    return _fd;
+}
+
+void SecV4L2KernelDevice::close(void)
+{
+    if (_fd < 0)
+        return;
+
+    ::close(_fd);
+    _fd = -1;
+}
+
+int SecV4L2KernelDevice::ioctl(unsigned long request, void* arg)
+{
+    return ::ioctl(_fd, request, arg);
+}
+
+void* SecV4L2KernelDevice::mmap(size_t length, off_t offset)
+{
+    return ::mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, offset);
+}
+
+int SecV4L2KernelDevice::munmap(void* start, size_t length)
+{
+    return ::munmap(start, length);
+}
+
+};
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_SEC_V4L2_DEVICE_H__
+#define __ANDROID_SEC_V4L2_DEVICE_H__
+
+#include <sys/types.h>
+
+// selects the backend. "kernel" or "fake"
+#define CAMERA_BACKEND_PROP     "camera.backend"
+// host builds have no kernel nodes to fall back to
+#ifndef CAMERA_BACKEND_DEF
+#define CAMERA_BACKEND_DEF      "kernel"
+#endif
+
+namespace android {
+
+// Everything SecV4L2Adapter does to a video node. open() returns an fd
+// that polls readable while a frame is waiting to be dequeued; ioctl()
+// follows the V4L2 ioctl contract of a node opened with O_NONBLOCK,
+// errno included. DQBUF on an empty queue fails with EAGAIN.
+class SecV4L2Device {
+public:
+    virtual ~SecV4L2Device() {}
+
+    virtual int open(const char* path) = 0;
+    virtual void close(void) = 0;
+    virtual int ioctl(unsigned long request, void* arg) = 0;
+    virtual void* mmap(size_t length, off_t offset) = 0;
+    virtual int munmap(void* start, size_t length) = 0;
+
+    static SecV4L2Device* create(void);
+};
+
+// a real V4L2 node
+class SecV4L2KernelDevice : public SecV4L2Device {
+public:
+    SecV4L2KernelDevice();
+    virtual ~SecV4L2KernelDevice();
+
+    virtual int open(const char* path);
+    virtual void close(void);
+    virtual int ioctl(unsigned long request, void* arg);
+    virtual void* mmap(size_t length, off_t offset);
+    virtual int munmap(void* start, size_t length);
+
+private:
+    int _fd;
+};
+
+};
+#endif
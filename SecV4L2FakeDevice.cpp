@@ -0,0 +1,749 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecV4L2FakeDevice"
+#include <utils/Log.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/ashmem.h>
+#include <cutils/properties.h>
+
+#include "SecV4L2FakeDevice.h"
+
+// what PADDR ctrls report. never dereferenced by the HAL itself
+#define FAKE_PADDR_BASE         (0x40000000)
+#define FAKE_DEFAULT_SIZES      "2560x1920,2048x1536,1600x1200,1280x720," \
+                                "720x480,640x480,320x240,176x144"
+
+// S5K4ECGX auto focus results
+#define FAKE_AF_SUCCESS         (0x02)
+
+namespace android {
+
+static const unsigned int _fakeFmts[] = {
+    V4L2_PIX_FMT_NV21,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_YUYV,
+};
+
+static const int _fakeFps[] = { 30, 15, 7 };
+
+#define NUM_FAKE_FMTS   (sizeof(_fakeFmts) / sizeof(_fakeFmts[0]))
+#define NUM_FAKE_FPS    (sizeof(_fakeFps) / sizeof(_fakeFps[0]))
+
+static size_t _fakeFrameSize(unsigned int fmt, int w, int h)
+{
+    if (fmt == V4L2_PIX_FMT_YUYV)
+        return w * h * 2;
+
+    return w * h * 3 / 2;
+}
+
+SecV4L2FakeDevice::SecV4L2FakeDevice() :
+    _fps(30),
+    _jitter(0),
+    _latency(0),
+    _sizeCnt(0),
+    _input(0),
+    _w(0),
+    _h(0),
+    _fmt(0),
+    _sizeImage(0),
+    _bufLen(0),
+    _bufCnt(0),
+    _memory(V4L2_MEMORY_MMAP),
+    _queuedCnt(0),
+    _doneCnt(0),
+    _streaming(false),
+    _sequence(0),
+    _lost(0),
+    _nextFrame(0)
+{
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+    memset(_bufs, 0, sizeof(_bufs));
+    memset(&_parm, 0, sizeof(_parm));
+}
+
+SecV4L2FakeDevice::~SecV4L2FakeDevice()
+{
+    close();
+}
+
+void SecV4L2FakeDevice::_loadConfig(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(FAKE_FPS_PROP, value, "30");
+    _fps = atoi(value);
+    if (_fps <= 0)
+        _fps = 30;
+
+    property_get(FAKE_JITTER_PROP, value, "0");
+    _jitter = us2ns(atoi(value));
+
+    property_get(FAKE_LATENCY_PROP, value, "0");
+    _latency = us2ns(atoi(value));
+
+    property_get(FAKE_SIZES_PROP, value, FAKE_DEFAULT_SIZES);
+    _sizeCnt = 0;
+    for (const char* p = value; p && _sizeCnt < MAX_FAKE_SIZES; ) {
+        int w, h;
+        if (sscanf(p, "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+            _sizes[_sizeCnt][0] = w;
+            _sizes[_sizeCnt][1] = h;
+            _sizeCnt++;
+        }
+        p = strchr(p, ',');
+        if (p)
+            p++;
+    }
+
+    LOGI("%s: %dfps, jitter %lldus, latency %lldus, %u sizes", __func__,
+         _fps, ns2us(_jitter), ns2us(_latency), _sizeCnt);
+}
+
+// The returned fd stands in for the video node: it polls readable while
+// a frame is waiting to be dequeued.
+int SecV4L2FakeDevice::open(const char* path)
+{
+    if (pipe(_pipe) < 0) {
+        LOGE("%s: pipe() failed (%s)", __func__, strerror(errno));
+        return -1;
+    }
+    fcntl(_pipe[0], F_SETFL, O_NONBLOCK);
+
+    _loadConfig();
+    LOGI("%s: %s faked by fd %d", __func__, path, _pipe[0]);
+
+    return _pipe[0];
+}
+
+void SecV4L2FakeDevice::close(void)
+{
+    _stream(false);
+
+    Mutex::Autolock lock(_lock);
+    _freeBufs();
+
+    for (int i = 0; i < 2; i++) {
+        if (_pipe[i] < 0)
+            continue;
+
+        ::close(_pipe[i]);
+        _pipe[i] = -1;
+    }
+}
+
+int SecV4L2FakeDevice::ioctl(unsigned long request, void* arg)
+{
+    int err;
+
+    // these two wait for the sensor thread and take the lock themselves
+    if (request == VIDIOC_STREAMON || request == VIDIOC_STREAMOFF) {
+        if (*(int*)arg != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+            err = EINVAL;
+        else
+            err = _stream(request == VIDIOC_STREAMON);
+    } else {
+        Mutex::Autolock lock(_lock);
+        err = _ioctlLocked(request, arg);
+    }
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_ioctlLocked(unsigned long request, void* arg)
+{
+    switch (request) {
+    case VIDIOC_QUERYCAP:
+        return _queryCap((struct v4l2_capability*)arg);
+    case VIDIOC_ENUMINPUT:
+        return _enumInput((struct v4l2_input*)arg);
+    case VIDIOC_S_INPUT:
+        _input = *(int*)arg;
+        return 0;
+    case VIDIOC_ENUM_FMT:
+        return _enumFmt((struct v4l2_fmtdesc*)arg);
+    case VIDIOC_ENUM_FRAMESIZES:
+        return _enumFrameSizes((struct v4l2_frmsizeenum*)arg);
+    case VIDIOC_ENUM_FRAMEINTERVALS:
+        return _enumFrameIntervals((struct v4l2_frmivalenum*)arg);
+    case VIDIOC_S_FMT:
+        return _setFmt((struct v4l2_format*)arg);
+    case VIDIOC_REQBUFS:
+        return _reqBufs((struct v4l2_requestbuffers*)arg);
+    case VIDIOC_QUERYBUF:
+        return _queryBuf((struct v4l2_buffer*)arg);
+#ifdef VIDIOC_EXPBUF
+    case VIDIOC_EXPBUF:
+        return _expBuf(arg);
+#endif
+    case VIDIOC_QBUF:
+        return _qBuf((struct v4l2_buffer*)arg);
+    case VIDIOC_DQBUF:
+        return _dqBuf((struct v4l2_buffer*)arg);
+    case VIDIOC_G_CTRL:
+        return _getCtrl((struct v4l2_control*)arg);
+    case VIDIOC_S_CTRL:
+        return _setCtrl((struct v4l2_control*)arg);
+    case VIDIOC_S_EXT_CTRLS:
+        return _setExtCtrls((struct v4l2_ext_controls*)arg);
+    case VIDIOC_G_PARM:
+        return _getParm((struct v4l2_streamparm*)arg);
+    case VIDIOC_S_PARM:
+        return _setParm((struct v4l2_streamparm*)arg);
+    default:
+        LOGV("%s: unsupported request %#lx", __func__, request);
+        return ENOTTY;
+    }
+}
+
+void* SecV4L2FakeDevice::mmap(size_t length, off_t offset)
+{
+    Mutex::Autolock lock(_lock);
+
+    if (_bufLen == 0 || offset % _bufLen)
+        return MAP_FAILED;
+
+    unsigned int idx = offset / _bufLen;
+    if (idx >= _bufCnt || _bufs[idx].fd < 0 || length > _bufLen)
+        return MAP_FAILED;
+
+    return ::mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  _bufs[idx].fd, 0);
+}
+
+int SecV4L2FakeDevice::munmap(void* start, size_t length)
+{
+    return ::munmap(start, length);
+}
+
+int SecV4L2FakeDevice::_queryCap(struct v4l2_capability* cap)
+{
+    memset(cap, 0, sizeof(*cap));
+    strncpy((char*)cap->driver, "fake-fimc", sizeof(cap->driver) - 1);
+    strncpy((char*)cap->card, "synthetic sensor", sizeof(cap->card) - 1);
+    strncpy((char*)cap->bus_info, "in-process", sizeof(cap->bus_info) - 1);
+
+    // SecV4L2Caps keys its disk cache on these. another size list has to
+    // look like another driver version, or stale sizes would be served
+    uint32_t version = 2166136261u;
+    for (unsigned int i = 0; i < _sizeCnt; i++) {
+        version = (version ^ _sizes[i][0]) * 16777619u;
+        version = (version ^ _sizes[i][1]) * 16777619u;
+    }
+    cap->version = version;
+    cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_enumInput(struct v4l2_input* input)
+{
+    if (input->index != 0)
+        return EINVAL;
+
+    int index = input->index;
+    memset(input, 0, sizeof(*input));
+    input->index = index;
+    input->type = V4L2_INPUT_TYPE_CAMERA;
+    strncpy((char*)input->name, "synthetic sensor", sizeof(input->name) - 1);
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_enumFmt(struct v4l2_fmtdesc* fmtdesc)
+{
+    if (fmtdesc->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+        fmtdesc->index >= NUM_FAKE_FMTS)
+        return EINVAL;
+
+    fmtdesc->flags = 0;
+    fmtdesc->pixelformat = _fakeFmts[fmtdesc->index];
+    snprintf((char*)fmtdesc->description, sizeof(fmtdesc->description),
+             "fake %c%c%c%c",
+             fmtdesc->pixelformat & 0xff,
+             (fmtdesc->pixelformat >> 8) & 0xff,
+             (fmtdesc->pixelformat >> 16) & 0xff,
+             (fmtdesc->pixelformat >> 24) & 0xff);
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_enumFrameSizes(struct v4l2_frmsizeenum* frmsize)
+{
+    if (frmsize->index >= _sizeCnt)
+        return EINVAL;
+
+    frmsize->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+    frmsize->discrete.width = _sizes[frmsize->index][0];
+    frmsize->discrete.height = _sizes[frmsize->index][1];
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_enumFrameIntervals(struct v4l2_frmivalenum* frmival)
+{
+    if (frmival->index >= NUM_FAKE_FPS)
+        return EINVAL;
+
+    frmival->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+    frmival->discrete.numerator = 1;
+    frmival->discrete.denominator = _fakeFps[frmival->index];
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_setFmt(struct v4l2_format* fmt)
+{
+    struct v4l2_pix_format* pix = &fmt->fmt.pix;
+
+    if (fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return EINVAL;
+
+    // like FIMC, a new format only needs the stream off. the buffers of
+    // the old one go with the next REQBUFS
+    if (_streaming)
+        return EBUSY;
+
+    bool found = false;
+    for (unsigned int i = 0; i < NUM_FAKE_FMTS; i++) {
+        if (_fakeFmts[i] == pix->pixelformat)
+            found = true;
+    }
+
+    if (!found || pix->width == 0 || pix->height == 0)
+        return EINVAL;
+
+    _w = pix->width;
+    _h = pix->height;
+    _fmt = pix->pixelformat;
+    _sizeImage = _fakeFrameSize(_fmt, _w, _h);
+
+    pix->field = V4L2_FIELD_NONE;
+    pix->bytesperline = _fmt == V4L2_PIX_FMT_YUYV ? _w * 2 : _w;
+    pix->sizeimage = _sizeImage;
+
+    return 0;
+}
+
+void SecV4L2FakeDevice::_freeBufs(void)
+{
+    for (unsigned int i = 0; i < _bufCnt; i++) {
+        if (_bufs[i].map)
+            ::munmap(_bufs[i].map, _bufLen);
+        if (_bufs[i].fd >= 0)
+            ::close(_bufs[i].fd);
+    }
+
+    memset(_bufs, 0, sizeof(_bufs));
+    _bufCnt = 0;
+    _queuedCnt = 0;
+    _doneCnt = 0;
+}
+
+int SecV4L2FakeDevice::_reqBufs(struct v4l2_requestbuffers* req)
+{
+    if (req->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return EINVAL;
+
+    if (req->memory != V4L2_MEMORY_MMAP && req->memory != V4L2_MEMORY_USERPTR)
+        return EINVAL;
+
+    if (_streaming)
+        return EBUSY;
+
+    _freeBufs();
+    if (req->count == 0)
+        return 0;
+
+    if (req->count > MAX_FAKE_BUFFERS)
+        req->count = MAX_FAKE_BUFFERS;
+
+    long page = sysconf(_SC_PAGESIZE);
+    _bufLen = (_sizeImage + page - 1) & ~(page - 1);
+    _memory = req->memory;
+
+    for (unsigned int i = 0; i < req->count; i++) {
+        struct fakeBuf* buf = &_bufs[i];
+        buf->fd = -1;
+        buf->state = BUF_DEQUEUED;
+
+        if (_memory == V4L2_MEMORY_USERPTR)
+            continue;
+
+        buf->fd = ashmem_create_region("fake-camera", _bufLen);
+        if (buf->fd < 0) {
+            LOGE("%s: no memory for buffer-%u", __func__, i);
+            break;
+        }
+
+        buf->map = ::mmap(0, _bufLen, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          buf->fd, 0);
+        if (buf->map == MAP_FAILED) {
+            ::close(buf->fd);
+            buf->fd = -1;
+            buf->map = NULL;
+            break;
+        }
+
+        _bufCnt = i + 1;
+    }
+
+    if (_memory == V4L2_MEMORY_USERPTR)
+        _bufCnt = req->count;
+
+    if (_bufCnt == 0)
+        return ENOMEM;
+
+    req->count = _bufCnt;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_queryBuf(struct v4l2_buffer* buf)
+{
+    if (buf->type != V4L2_BUF_TYPE_VIDEO_CAPTURE || buf->index >= _bufCnt)
+        return EINVAL;
+
+    buf->memory = _memory;
+    buf->length = _bufLen;
+    buf->m.offset = buf->index * _bufLen;
+    buf->flags = V4L2_BUF_FLAG_MAPPED;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_expBuf(void* arg)
+{
+#ifdef VIDIOC_EXPBUF
+    struct v4l2_exportbuffer* expbuf = (struct v4l2_exportbuffer*)arg;
+
+    if (expbuf->index >= _bufCnt || _bufs[expbuf->index].fd < 0)
+        return EINVAL;
+
+    expbuf->fd = dup(_bufs[expbuf->index].fd);
+    if (expbuf->fd < 0)
+        return errno;
+
+    if (expbuf->flags & O_CLOEXEC)
+        fcntl(expbuf->fd, F_SETFD, FD_CLOEXEC);
+
+    return 0;
+#else
+    return ENOTTY;
+#endif
+}
+
+int SecV4L2FakeDevice::_qBuf(struct v4l2_buffer* buf)
+{
+    if (buf->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
+        buf->memory != (unsigned int)_memory || buf->index >= _bufCnt)
+        return EINVAL;
+
+    struct fakeBuf* fb = &_bufs[buf->index];
+    if (fb->state != BUF_DEQUEUED)
+        return EINVAL;
+
+    if (_memory == V4L2_MEMORY_USERPTR) {
+        if (buf->m.userptr == 0 || buf->length < _sizeImage)
+            return EINVAL;
+        fb->userptr = (void*)buf->m.userptr;
+    } else if (_sizeImage > _bufLen) {
+        return EINVAL;
+    }
+
+    fb->state = BUF_QUEUED;
+    _queued[_queuedCnt++] = buf->index;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_dqBuf(struct v4l2_buffer* buf)
+{
+    if (buf->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return EINVAL;
+
+    // behaves like a node opened with O_NONBLOCK
+    if (_doneCnt == 0)
+        return _streaming ? EAGAIN : EINVAL;
+
+    unsigned int idx = _done[0];
+    memmove(&_done[0], &_done[1], sizeof(_done[0]) * --_doneCnt);
+
+    char c;
+    read(_pipe[0], &c, 1);
+
+    struct fakeBuf* fb = &_bufs[idx];
+    fb->state = BUF_DEQUEUED;
+
+    buf->index = idx;
+    buf->memory = _memory;
+    buf->bytesused = _sizeImage;
+    buf->flags = V4L2_BUF_FLAG_MAPPED;
+    buf->field = V4L2_FIELD_NONE;
+    buf->timestamp = fb->timestamp;
+    buf->sequence = fb->sequence;
+    buf->length = _bufLen;
+    if (_memory == V4L2_MEMORY_USERPTR)
+        buf->m.userptr = (unsigned long)fb->userptr;
+    else
+        buf->m.offset = idx * _bufLen;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_stream(bool on)
+{
+    _lock.lock();
+
+    if (on) {
+        // S_FMT may have grown frames past buffers of the last REQBUFS
+        if (_bufCnt == 0 || _sizeImage > _bufLen) {
+            _lock.unlock();
+            return EINVAL;
+        }
+
+        if (!_streaming) {
+            _streaming = true;
+            _sequence = 0;
+            _lost = 0;
+            _nextFrame = systemTime(SYSTEM_TIME_MONOTONIC);
+            _thread = new SensorThread(this);
+            _thread->run("FakeSensor", PRIORITY_URGENT_DISPLAY);
+        }
+
+        _lock.unlock();
+        return 0;
+    }
+
+    _streaming = false;
+    _lock.unlock();
+
+    if (_thread != NULL) {
+        _thread->requestExitAndWait();
+        _thread.clear();
+    }
+
+    // every buffer goes back to the application, done or not
+    Mutex::Autolock lock(_lock);
+    for (unsigned int i = 0; i < _bufCnt; i++)
+        _bufs[i].state = BUF_DEQUEUED;
+    _queuedCnt = 0;
+    _doneCnt = 0;
+
+    char c;
+    while (_pipe[0] >= 0 && read(_pipe[0], &c, 1) == 1)
+        ;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_getCtrl(struct v4l2_control* ctrl)
+{
+    switch (ctrl->id) {
+    case V4L2_CID_CAMERA_AUTO_FOCUS_RESULT_FIRST:
+        ctrl->value = FAKE_AF_SUCCESS;
+        return 0;
+    case V4L2_CID_CAMERA_AUTO_FOCUS_RESULT_SECOND:
+        ctrl->value = 0;
+        return 0;
+    case V4L2_CID_IS_GET_FRAME_NUMBER:
+        ctrl->value = _sequence;
+        return 0;
+    case V4L2_CID_IS_GET_LOSTED_FRAME_NUMBER:
+        ctrl->value = _lost;
+        return 0;
+    default:
+        break;
+    }
+
+    ssize_t i = _ctrls.indexOfKey(ctrl->id);
+    ctrl->value = i >= 0 ? _ctrls.valueAt(i) : 0;
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_setCtrl(struct v4l2_control* ctrl)
+{
+    switch (ctrl->id) {
+    case V4L2_CID_PADDR_Y:
+    case V4L2_CID_PADDR_CBCR:
+        if ((unsigned int)ctrl->value >= _bufCnt)
+            return EINVAL;
+
+        // the driver hands the address back in place of the index
+        ctrl->value = FAKE_PADDR_BASE + ctrl->value * _bufLen;
+        if (ctrl->id == V4L2_CID_PADDR_CBCR)
+            ctrl->value += _w * _h;
+        return 0;
+
+    case V4L2_CID_CAMERA_RESET:
+        _ctrls.clear();
+        return 0;
+
+    default:
+        _ctrls.add(ctrl->id, ctrl->value);
+        return 0;
+    }
+}
+
+int SecV4L2FakeDevice::_setExtCtrls(struct v4l2_ext_controls* ctrls)
+{
+    for (unsigned int i = 0; i < ctrls->count; i++) {
+        struct v4l2_control ctrl;
+        ctrl.id = ctrls->controls[i].id;
+        ctrl.value = ctrls->controls[i].value;
+
+        int err = _setCtrl(&ctrl);
+        if (err) {
+            ctrls->error_idx = i;
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_getParm(struct v4l2_streamparm* parm)
+{
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return EINVAL;
+
+    memcpy(&parm->parm.raw_data, &_parm, sizeof(_parm));
+
+    return 0;
+}
+
+int SecV4L2FakeDevice::_setParm(struct v4l2_streamparm* parm)
+{
+    if (parm->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return EINVAL;
+
+    memcpy(&_parm, &parm->parm.raw_data, sizeof(_parm));
+
+    // frame rate asked through the stream params wins over the property
+    const struct v4l2_fract* tpf = &_parm.capture.timeperframe;
+    if (tpf->numerator && tpf->denominator / tpf->numerator > 0)
+        _fps = tpf->denominator / tpf->numerator;
+
+    return 0;
+}
+
+void SecV4L2FakeDevice::_fillFrame(unsigned char* frame, unsigned int sequence)
+{
+    // horizontal bands rolling down by frame, so that dropped or repeated
+    // frames show on screen. chroma is left neutral
+    if (_fmt == V4L2_PIX_FMT_YUYV) {
+        for (int y = 0; y < _h; y++) {
+            unsigned char luma = (y + sequence * 4) & 0xff;
+            unsigned char* p = frame + y * _w * 2;
+            for (int x = 0; x < _w; x++) {
+                p[x * 2] = luma;
+                p[x * 2 + 1] = 128;
+            }
+        }
+        return;
+    }
+
+    for (int y = 0; y < _h; y++)
+        memset(frame + y * _w, (y + sequence * 4) & 0xff, _w);
+    memset(frame + _w * _h, 128, _sizeImage - _w * _h);
+}
+
+bool SecV4L2FakeDevice::_sensorLoop(void)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    _lock.lock();
+    nsecs_t period = seconds_to_nanoseconds(1) / _fps;
+    _nextFrame += period;
+    // don't try to catch up after a stall
+    if (_nextFrame < now - period)
+        _nextFrame = now;
+
+    nsecs_t wake = _nextFrame;
+    int jitterUs = ns2us(_jitter);
+    if (jitterUs)
+        wake += us2ns(rand() % (2 * jitterUs + 1) - jitterUs);
+    _lock.unlock();
+
+    if (wake > now)
+        usleep(ns2us(wake - now));
+
+    _lock.lock();
+    if (!_streaming) {
+        _lock.unlock();
+        return false;
+    }
+
+    unsigned int sequence = _sequence++;
+    if (_queuedCnt == 0) {
+        // nowhere to capture to. lost, like on the real driver
+        LOGV("%s: frame #%u dropped", __func__, sequence);
+        _lost++;
+        _lock.unlock();
+        return true;
+    }
+
+    unsigned int idx = _queued[0];
+    memmove(&_queued[0], &_queued[1], sizeof(_queued[0]) * --_queuedCnt);
+
+    struct fakeBuf* buf = &_bufs[idx];
+    unsigned char* frame = (unsigned char*)
+        (_memory == V4L2_MEMORY_USERPTR ? buf->userptr : buf->map);
+    nsecs_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    _lock.unlock();
+
+    // the buffer is ours until it is done. STREAMOFF waits for us
+    _fillFrame(frame, sequence);
+    if (_latency)
+        usleep(ns2us(_latency));
+
+    _lock.lock();
+    if (!_streaming) {
+        _lock.unlock();
+        return false;
+    }
+
+    buf->state = BUF_DONE;
+    buf->sequence = sequence;
+    buf->timestamp.tv_sec = timestamp / seconds_to_nanoseconds(1);
+    buf->timestamp.tv_usec = ns2us(timestamp % seconds_to_nanoseconds(1));
+    _done[_doneCnt++] = idx;
+
+    write(_pipe[1], "f", 1);
+    _lock.unlock();
+
+    return true;
+}
+
+};
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_SEC_V4L2_FAKE_DEVICE_H__
+#define __ANDROID_SEC_V4L2_FAKE_DEVICE_H__
+
+#include <linux/videodev2.h>
+#include <utils/threads.h>
+#include <utils/KeyedVector.h>
+#include "videodev2_samsung.h"
+#include "SecV4L2Device.h"
+
+#define MAX_FAKE_BUFFERS        (16)
+#define MAX_FAKE_SIZES          (16)
+
+// tunables of the synthetic sensor
+#define FAKE_FPS_PROP           "camera.fake.fps"
+#define FAKE_JITTER_PROP        "camera.fake.jitter_us"
+#define FAKE_LATENCY_PROP       "camera.fake.latency_us"
+#define FAKE_SIZES_PROP         "camera.fake.sizes"
+
+namespace android {
+
+// An in-process stand-in for a FIMC capture node. Frames are generated
+// by a thread at a set rate, with optional jitter, and become available
+// for DQBUF after a simulated driver latency. Buffers live in ashmem so
+// they can be exported and mapped like dma-bufs.
+class SecV4L2FakeDevice : public SecV4L2Device {
+public:
+    SecV4L2FakeDevice();
+    virtual ~SecV4L2FakeDevice();
+
+    virtual int open(const char* path);
+    virtual void close(void);
+    virtual int ioctl(unsigned long request, void* arg);
+    virtual void* mmap(size_t length, off_t offset);
+    virtual int munmap(void* start, size_t length);
+
+private:
+    class SensorThread : public Thread {
+        SecV4L2FakeDevice* _dev;
+    public:
+        SensorThread(SecV4L2FakeDevice* dev):Thread(false), _dev(dev) { }
+        virtual bool threadLoop() { return _dev->_sensorLoop(); }
+    };
+    sp<SensorThread> _thread;
+    bool _sensorLoop(void);
+
+    enum bufState {
+        BUF_DEQUEUED = 0,
+        BUF_QUEUED,
+        BUF_DONE
+    };
+
+    struct fakeBuf {
+        int fd;
+        void* map;
+        void* userptr;
+        enum bufState state;
+        struct timeval timestamp;
+        unsigned int sequence;
+    };
+
+    mutable Mutex _lock;
+    int _pipe[2];
+
+    // sensor
+    int _fps;
+    nsecs_t _jitter;
+    nsecs_t _latency;
+    unsigned int _sizeCnt;
+    int _sizes[MAX_FAKE_SIZES][2];
+    int _input;
+
+    // format
+    int _w;
+    int _h;
+    unsigned int _fmt;
+    size_t _sizeImage;
+    size_t _bufLen;
+
+    // buffers, and queues of their indices in order
+    struct fakeBuf _bufs[MAX_FAKE_BUFFERS];
+    unsigned int _bufCnt;
+    int _memory;
+    unsigned int _queued[MAX_FAKE_BUFFERS];
+    unsigned int _queuedCnt;
+    unsigned int _done[MAX_FAKE_BUFFERS];
+    unsigned int _doneCnt;
+
+    bool _streaming;
+    unsigned int _sequence;
+    unsigned int _lost;
+    nsecs_t _nextFrame;
+
+    KeyedVector<int, int> _ctrls;
+    struct sec_cam_parm _parm;
+
+    int _ioctlLocked(unsigned long request, void* arg);
+    void _loadConfig(void);
+    void _freeBufs(void);
+    void _fillFrame(unsigned char* frame, unsigned int sequence);
+
+    int _queryCap(struct v4l2_capability* cap);
+    int _enumInput(struct v4l2_input* input);
+    int _enumFmt(struct v4l2_fmtdesc* fmtdesc);
+    int _enumFrameSizes(struct v4l2_frmsizeenum* frmsize);
+    int _enumFrameIntervals(struct v4l2_frmivalenum* frmival);
+    int _setFmt(struct v4l2_format* fmt);
+    int _reqBufs(struct v4l2_requestbuffers* req);
+    int _queryBuf(struct v4l2_buffer* buf);
+    int _expBuf(void* arg);
+    int _qBuf(struct v4l2_buffer* buf);
+    int _dqBuf(struct v4l2_buffer* buf);
+    int _stream(bool on);
+    int _getCtrl(struct v4l2_control* ctrl);
+    int _setCtrl(struct v4l2_control* ctrl);
+    int _setExtCtrls(struct v4l2_ext_controls* ctrls);
+    int _getParm(struct v4l2_streamparm* parm);
+    int _setParm(struct v4l2_streamparm* parm);
+};
+
+};
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecV4L2Reactor"
+#include <utils/Log.h>
+#include "CameraLog.h"
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "SecV4L2Reactor.h"
+
+#define MAX_REACTOR_EVENTS      (8)
+// epoll id of the wake pipe. never handed out to a node
+#define REACTOR_WAKE_ID         (1u << 31)
+
+namespace android {
+
+SecV4L2Reactor::SecV4L2Reactor():
+    _epollFd(-1),
+    _nodeCnt(0)
+{
+    _wakePipe[0] = _wakePipe[1] = -1;
+
+    _epollFd = epoll_create(MAX_REACTOR_EVENTS);
+    if (_epollFd < 0) {
+        LOGE("%s: epoll_create failed (%s)", __func__, strerror(errno));
+        return;
+    }
+
+    if (pipe(_wakePipe) < 0) {
+        LOGE("%s: pipe() failed (%s)", __func__, strerror(errno));
+        _wakePipe[0] = _wakePipe[1] = -1;
+        return;
+    }
+    fcntl(_wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(_wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = REACTOR_WAKE_ID;
+    LOGE_IF(epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakePipe[0], &ev) < 0,
+            "%s: failed to add wake pipe (%s)", __func__, strerror(errno));
+}
+
+SecV4L2Reactor::~SecV4L2Reactor()
+{
+    if (_epollFd >= 0) {
+        close(_epollFd);
+        _epollFd = -1;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (_wakePipe[i] >= 0)
+            close(_wakePipe[i]);
+    }
+}
+
+int SecV4L2Reactor::addNode(SecV4L2Adapter* node, unsigned int id)
+{
+    LOG_CAMERA_FUNC_ENTER;
+    if (_epollFd < 0 || node == NULL || node->getFd() == 0) {
+        LOGE("%s: invalid reactor or node!", __func__);
+        return -1;
+    }
+
+    if (id == 0 || (id & REACTOR_WAKE_ID)) {
+        LOGE("%s: invalid id, 0x%x!", __func__, id);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLERR;
+    ev.data.u32 = id;
+
+    int ret = epoll_ctl(_epollFd, EPOLL_CTL_ADD, node->getFd(), &ev);
+    if (ret < 0 && errno == EEXIST)
+        ret = epoll_ctl(_epollFd, EPOLL_CTL_MOD, node->getFd(), &ev);
+    else if (ret == 0)
+        _nodeCnt++;
+
+    if (ret < 0) {
+        LOGE("%s: failed to add fd %d (%s)", __func__,
+             node->getFd(), strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int SecV4L2Reactor::removeNode(SecV4L2Adapter* node)
+{
+    LOG_CAMERA_FUNC_ENTER;
+    if (_epollFd < 0 || node == NULL || node->getFd() == 0)
+        return -1;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_DEL, node->getFd(), &ev) < 0)
+        return -1;
+
+    _nodeCnt--;
+
+    return 0;
+}
+
+// Returns the OR-ed ids of ready nodes, 0 on timeout or wake() or -1 on
+// error.
+int SecV4L2Reactor::waitNodes(int timeout)
+{
+    struct epoll_event events[MAX_REACTOR_EVENTS];
+
+    if (_epollFd < 0)
+        return -1;
+
+    nsecs_t start = systemTime();
+    int n = epoll_wait(_epollFd, events, MAX_REACTOR_EVENTS, timeout);
+    _stats.add(SecV4L2Stats::OP_POLL, systemTime() - start, n <= 0);
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+
+        LOGE("ERR(%s):epoll_wait error (%s)\n", __func__, strerror(errno));
+        return -1;
+    }
+
+    if (n == 0) {
+        LOGW("%s: no frame in %d msecs", __func__, timeout);
+        return 0;
+    }
+
+    int ready = 0;
+    for (int i = 0; i < n; i++)
+        ready |= events[i].data.u32;
+
+    if (ready & REACTOR_WAKE_ID) {
+        char buf[8];
+        while (read(_wakePipe[0], buf, sizeof(buf)) > 0)
+            ;
+        ready &= ~REACTOR_WAKE_ID;
+    }
+
+    return ready;
+}
+
+// Make a waitNodes() in progress, or the next one, return early so its
+// caller can look at its state again.
+void SecV4L2Reactor::wake(void)
+{
+    if (_wakePipe[1] >= 0)
+        write(_wakePipe[1], "w", 1);
+}
+
+void SecV4L2Reactor::dump(String8& result)
+{
+    result.appendFormat("  reactor: nodes=%u\n", _nodeCnt);
+    _stats.dump(result, "reactor");
+}
+
+};
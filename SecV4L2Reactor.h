@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_SEC_V4L2_REACTOR_H__
+#define __ANDROID_SEC_V4L2_REACTOR_H__
+
+#include "SecV4L2Adapter.h"
+#include "SecV4L2Stats.h"
+
+namespace android {
+
+// Waits on every registered video node at once, so that a slow node
+// never delays frames of the others. Each node is registered with a
+// single bit id and waitNodes() returns the ids of the ready nodes.
+class SecV4L2Reactor {
+public:
+    SecV4L2Reactor();
+    ~SecV4L2Reactor();
+
+    int addNode(SecV4L2Adapter* node, unsigned int id);
+    int removeNode(SecV4L2Adapter* node);
+    int waitNodes(int timeout);
+    void wake(void);
+    void dump(String8& result);
+
+private:
+    int _epollFd;
+    unsigned int _nodeCnt;
+    // polled along with the nodes; wake() writes to it
+    int _wakePipe[2];
+    SecV4L2Stats _stats;
+};
+
+};
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecV4L2Stats"
+#include <utils/Log.h>
+
+#include <string.h>
+#include <linux/videodev2.h>
+#include <cutils/atomic.h>
+
+#include "SecV4L2Stats.h"
+
+namespace android {
+
+static const char* _opNames[SecV4L2Stats::OP_MAX] = {
+    "QUERYCAP",
+    "S_INPUT",
+    "S_FMT",
+    "REQBUFS",
+    "QUERYBUF",
+    "EXPBUF",
+    "QBUF",
+    "DQBUF",
+    "STREAMON/OFF",
+    "G_CTRL",
+    "S_CTRL",
+    "S_EXT_CTRLS",
+    "G_PARM",
+    "S_PARM",
+    "other",
+    "poll",
+};
+
+SecV4L2Stats::SecV4L2Stats()
+{
+    memset(_ops, 0, sizeof(_ops));
+}
+
+int SecV4L2Stats::opOf(unsigned long request)
+{
+    switch (request) {
+    case VIDIOC_QUERYCAP:       return OP_QUERYCAP;
+    case VIDIOC_S_INPUT:        return OP_S_INPUT;
+    case VIDIOC_S_FMT:          return OP_S_FMT;
+    case VIDIOC_REQBUFS:        return OP_REQBUFS;
+    case VIDIOC_QUERYBUF:       return OP_QUERYBUF;
+#ifdef VIDIOC_EXPBUF
+    case VIDIOC_EXPBUF:         return OP_EXPBUF;
+#endif
+    case VIDIOC_QBUF:           return OP_QBUF;
+    case VIDIOC_DQBUF:          return OP_DQBUF;
+    case VIDIOC_STREAMON:
+    case VIDIOC_STREAMOFF:      return OP_STREAM;
+    case VIDIOC_G_CTRL:         return OP_G_CTRL;
+    case VIDIOC_S_CTRL:         return OP_S_CTRL;
+    case VIDIOC_S_EXT_CTRLS:    return OP_S_EXT_CTRLS;
+    case VIDIOC_G_PARM:         return OP_G_PARM;
+    case VIDIOC_S_PARM:         return OP_S_PARM;
+    default:                    return OP_OTHER;
+    }
+}
+
+void SecV4L2Stats::add(int op, nsecs_t elapsed, bool failed)
+{
+    struct opStat* stat = &_ops[op];
+    int32_t us = (int32_t)ns2us(elapsed);
+
+    int bucket = 0;
+    for (int32_t v = us >> 1; v && bucket < STATS_BUCKETS - 1; v >>= 1)
+        bucket++;
+
+    android_atomic_inc(&stat->count);
+    android_atomic_add(us, &stat->totalUs);
+    android_atomic_inc(&stat->buckets[bucket]);
+    if (failed)
+        android_atomic_inc(&stat->errors);
+
+    int32_t max = stat->maxUs;
+    while (us > max) {
+        if (android_atomic_cmpxchg(max, us, &stat->maxUs) == 0)
+            break;
+        max = stat->maxUs;
+    }
+}
+
+void SecV4L2Stats::dump(String8& result, const char* name)
+{
+    for (int i = 0; i < OP_MAX; i++) {
+        const struct opStat* stat = &_ops[i];
+        int32_t count = stat->count;
+        if (count == 0)
+            continue;
+
+        result.appendFormat("  %s %s: calls=%d errors=%d avg=%uus max=%dus\n"
+                            "   ",
+                            name, _opNames[i], count, stat->errors,
+                            (uint32_t)stat->totalUs / count, stat->maxUs);
+        for (int b = 0; b < STATS_BUCKETS; b++) {
+            if (stat->buckets[b] == 0)
+                continue;
+
+            if (b == STATS_BUCKETS - 1)
+                result.appendFormat(" >=%dus:%d", 1 << b, stat->buckets[b]);
+            else
+                result.appendFormat(" <%dus:%d", 2 << b, stat->buckets[b]);
+        }
+        result.append("\n");
+    }
+}
+
+};
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2012 Homin Lee <suapapa@insignal.co.kr>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ANDROID_SEC_V4L2_STATS_H__
+#define __ANDROID_SEC_V4L2_STATS_H__
+
+#include <stdint.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+
+// latency buckets. bucket n counts calls of [2^n, 2^(n+1)) usecs, the
+// last one everything longer
+#define STATS_BUCKETS           (16)
+
+namespace android {
+
+// Call counts, failures and latency histograms of what an adapter does
+// to its node. Counters are updated with atomics only, so it stays on
+// always and can be dumped while streaming. Totals are in usecs and wrap
+// after about 71 minutes spent in one kind of call.
+class SecV4L2Stats {
+public:
+    enum op {
+        OP_QUERYCAP = 0,
+        OP_S_INPUT,
+        OP_S_FMT,
+        OP_REQBUFS,
+        OP_QUERYBUF,
+        OP_EXPBUF,
+        OP_QBUF,
+        OP_DQBUF,
+        OP_STREAM,
+        OP_G_CTRL,
+        OP_S_CTRL,
+        OP_S_EXT_CTRLS,
+        OP_G_PARM,
+        OP_S_PARM,
+        OP_OTHER,
+        OP_POLL,        // time blocked waiting for a frame
+        OP_MAX
+    };
+
+    SecV4L2Stats();
+
+    static int opOf(unsigned long request);
+    void add(int op, nsecs_t elapsed, bool failed);
+    void dump(String8& result, const char* name);
+
+private:
+    struct opStat {
+        volatile int32_t count;
+        volatile int32_t errors;
+        volatile int32_t totalUs;
+        volatile int32_t maxUs;
+        volatile int32_t buckets[STATS_BUCKETS];
+    };
+    struct opStat _ops[OP_MAX];
+};
+
+};
+#endif